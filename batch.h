@@ -0,0 +1,220 @@
+// Many independent car games stepped together, for training and evaluation.
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <vector>
+
+#include "world.h"
+#include "parallel.h"
+
+// Batch of count independent worlds. The cars are kept as a structure of arrays
+// and every world has its own obstacle field, so worlds share nothing and
+// step() can advance them in parallel on a thread pool: each field, with the run
+// cache its collision queries fill, is only touched by the thread stepping its
+// world. A world that has been lost or won is reset by step() itself
+// RESET_DELAY_STEPS steps later with a new layout, like a World: each loss or win
+// schedules a TIMER_RESET_WORLD for the world on the timer wheel of the batch,
+// which step() ticks once the worlds have moved. World w draws its layouts from
+// stream w of the seed, so it plays just like a World seeded with that stream.
+class WorldBatch
+{
+public:
+    WorldBatch(int count, const LayoutParams& params, uint64_t seed,
+        int threads = defaultThreadCount());
+    void reset();
+    void step(const int* inputs, int* events);
+    int getCount() const { return count; }
+    CarState getState(int w) const;
+    const ObstacleField& getField(int w) const { return fields[w]; }
+    const float* getX() const { return carX.data(); }
+    const float* getZ() const { return carZ.data(); }
+    const float* getAngle() const { return carAngle.data(); }
+    const float* getSpeed() const { return carSpeed.data(); }
+    const unsigned char* getCollision() const { return collision.data(); }
+    const unsigned char* getWin() const { return win.data(); }
+    int getThreadCount() const { return pool.getThreadCount(); }
+
+private:
+    void resetWorld(int w);
+    void stepRange(int begin, int end, const int* inputs, int* events);
+
+    int count;
+    LayoutParams params; // Parameters of every layout generated.
+    std::vector<float> carX, carZ, carAngle, carSpeed; // Car of each world.
+    std::vector<float> carHeadingX, carHeadingZ; // Unit vector each car faces, kept with its angle.
+    std::vector<int> live; // Worlds still being played in each block of stepRange(), packed to its start.
+    std::vector<float> nextX, nextZ, nextAngle, nextSpeed; // Car of each live world after the vehicle model.
+    std::vector<float> nextHeadingX, nextHeadingZ;
+    std::vector<float> throttle, brake, steer; // Controls of each live world this step.
+    std::vector<unsigned char> collision, win; // Flags of each world.
+    TimerWheel timers; // Pending resets, with the world as the timer value.
+    std::vector<int> resetting; // Worlds whose reset fired this step.
+    std::vector<Pcg32> randoms; // Generator of the next layout of each world.
+    std::vector<ObstacleField> fields; // Layout of each world.
+    std::vector<int> triggerStart; // First entry of each world in triggerReached.
+    std::vector<unsigned char> triggerReached; // Has the car reached each trigger, world by world?
+    ThreadPool pool;
+};
+
+// WorldBatch constructor. Generates a layout with params for each world, and
+// starts the cars.
+// World w draws its layouts from stream w of seed, so the layouts are generated in
+// parallel and are the same for any number of threads. The layouts are small and
+// many, so no distance fields are baked for them.
+inline WorldBatch::WorldBatch(int count, const LayoutParams& params, uint64_t seed, int threads) :
+    count(count), params(params), pool(threads)
+{
+    int w;
+
+    randoms.resize(count);
+    fields.resize(count);
+    pool.run(count, [&](int begin, int end)
+        {
+            for (int k = begin; k < end; k++)
+            {
+                randoms[k].seed(seed, k);
+                fields[k].bakeDistanceField = 0;
+                fields[k].generateLayout(params, randoms[k], 1);
+                fields[k].build(1);
+            }
+        });
+
+    triggerStart.resize(count + 1);
+    triggerStart[0] = 0;
+    for (w = 0; w < count; w++)
+        triggerStart[w + 1] = triggerStart[w] + fields[w].triggers.getCount();
+
+    carX.resize(count);
+    carZ.resize(count);
+    carAngle.resize(count);
+    carSpeed.resize(count);
+    carHeadingX.resize(count);
+    carHeadingZ.resize(count);
+    nextX.resize(count);
+    nextZ.resize(count);
+    nextAngle.resize(count);
+    nextSpeed.resize(count);
+    nextHeadingX.resize(count);
+    nextHeadingZ.resize(count);
+    throttle.resize(count);
+    brake.resize(count);
+    steer.resize(count);
+    live.resize(count);
+    collision.resize(count);
+    win.resize(count);
+    triggerReached.resize(triggerStart[count]);
+    reset();
+}
+
+// Function to put the car of every world back at the start of its layout,
+// dropping the pending resets.
+inline void WorldBatch::reset()
+{
+    timers = TimerWheel();
+    for (int w = 0; w < count; w++)
+        resetWorld(w);
+}
+
+// Function to put the car of world w back at the start of its layout.
+inline void WorldBatch::resetWorld(int w)
+{
+    carX[w] = carZ[w] = carAngle[w] = carSpeed[w] = 0.0;
+    carHeadingX[w] = 0.0;
+    carHeadingZ[w] = -1.0; // Facing the -z direction.
+    collision[w] = win[w] = 0;
+    for (int k = triggerStart[w]; k < triggerStart[w + 1]; k++)
+        triggerReached[k] = 0;
+}
+
+// Function returning the car state of world w.
+inline CarState WorldBatch::getState(int w) const
+{
+    CarState state;
+    state.x = carX[w];
+    state.z = carZ[w];
+    state.angle = carAngle[w];
+    state.speed = carSpeed[w];
+    state.isCollision = collision[w];
+    state.isWin = win[w];
+    return state;
+}
+
+// Function to advance every world w by one step holding the key for the INPUT_*
+// value inputs[w], setting events[w] to the EVENT_* values that happened in it.
+// The worlds move in parallel; the resets are scheduled and fired afterwards on
+// the calling thread, and the worlds they fire for get their new layouts in
+// parallel again. Generated layouts of the same parameters have the same
+// triggers, so the reached flags of the other worlds stay where they are.
+inline void WorldBatch::step(const int* inputs, int* events)
+{
+    pool.run(count, [&](int begin, int end) { stepRange(begin, end, inputs, events); });
+
+    for (int w = 0; w < count; w++)
+        if (events[w] & (EVENT_LOST | EVENT_WON))
+            timers.schedule(RESET_DELAY_STEPS, TIMER_RESET_WORLD, w, 1);
+    resetting.clear();
+    timers.advance(1, [&](int, int w)
+        {
+            resetting.push_back(w);
+            events[w] |= EVENT_RESET;
+        });
+    pool.run((int)resetting.size(), [&](int begin, int end)
+        {
+            for (int k = begin; k < end; k++)
+            {
+                int w = resetting[k];
+                fields[w].generateLayout(params, randoms[w], 1);
+                fields[w].build(1);
+                resetWorld(w);
+            }
+        });
+}
+
+// Function to advance the worlds in [begin, end) by one step. The worlds still
+// being played are packed to the start of the block, so the vehicle model runs
+// for just them in one loop over the structure of arrays; a world that is over
+// waits for its reset. Then each move is checked against the layout of its world.
+inline void WorldBatch::stepRange(int begin, int end, const int* inputs, int* events)
+{
+    int w, n, playing = 0;
+
+    for (w = begin; w < end; w++)
+    {
+        if (collision[w] || win[w])
+        {
+            events[w] = 0; // The world is over and waits for its reset.
+            continue;
+        }
+        CarControls controls = inputControls(inputs[w]);
+        n = begin + playing++;
+        live[n] = w;
+        throttle[n] = controls.throttle;
+        brake[n] = controls.brake;
+        steer[n] = controls.steer;
+        nextX[n] = carX[w];
+        nextZ[n] = carZ[w];
+        nextAngle[n] = carAngle[w];
+        nextSpeed[n] = carSpeed[w];
+    }
+    integrateVehicles(playing, &nextX[begin], &nextZ[begin], &nextAngle[begin], &nextSpeed[begin],
+        &nextHeadingX[begin], &nextHeadingZ[begin], &throttle[begin], &brake[begin], &steer[begin]);
+
+    for (n = begin; n < begin + playing; n++)
+    {
+        w = live[n];
+        CarState state = getState(w);
+        CarPose pose = makeCarPose(carX[w], carZ[w], carAngle[w], carHeadingX[w], carHeadingZ[w]);
+        events[w] = resolveCarMove(fields[w], state, pose, triggerReached.data() + triggerStart[w],
+            makeCarPose(nextX[n], nextZ[n], nextAngle[n], nextHeadingX[n], nextHeadingZ[n]), nextSpeed[n]);
+        carX[w] = state.x;
+        carZ[w] = state.z;
+        carAngle[w] = state.angle;
+        carHeadingX[w] = pose.headingX;
+        carHeadingZ[w] = pose.headingZ;
+        carSpeed[w] = state.speed;
+        collision[w] = (unsigned char)state.isCollision;
+        win[w] = (unsigned char)state.isWin;
+    }
+}
+
+#endif
@@ -0,0 +1,97 @@
+// World batch test. Runs headless, no window is opened.
+//
+// Build: g++ -O2 -std=c++17 batch_test.cpp -o batch_test -lpthread
+// Usage: batch_test [--worlds N] [--steps S] [--seed S] [--threads T]
+//
+// Steps a WorldBatch of random drivers on T threads next to one World per world
+// of the batch, World w seeded with stream w of the seed, through many resets.
+// Every step, each world of the batch must give the same events and car state as
+// its World, and after a reset the same new layout. Prints the mismatches found
+// and returns 1 if there are any.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "batch.h"
+
+#define HOLD_STEPS 10 // Longest run of steps an input is held for.
+
+// Function to check if the cubes of a and b are the same.
+static int sameCubes(const CubeStore& a, const CubeStore& b)
+{
+    if (a.getCount() != b.getCount())
+        return 0;
+    for (int k = 0; k < a.getCount(); k++)
+        if (a.getX()[k] != b.getX()[k] || a.getZ()[k] != b.getZ()[k] || a.getR()[k] != b.getR()[k])
+            return 0;
+    return 1;
+}
+
+// Main routine.
+int main(int argc, char** argv)
+{
+    int worlds = 64, steps = 3000, seed = 1, threads = 4;
+
+    for (int n = 1; n < argc; n++)
+        if (!strcmp(argv[n], "--worlds") && n + 1 < argc)
+            worlds = atoi(argv[++n]);
+        else if (!strcmp(argv[n], "--steps") && n + 1 < argc)
+            steps = atoi(argv[++n]);
+        else if (!strcmp(argv[n], "--seed") && n + 1 < argc)
+            seed = atoi(argv[++n]);
+        else if (!strcmp(argv[n], "--threads") && n + 1 < argc)
+            threads = atoi(argv[++n]);
+        else
+        {
+            fprintf(stderr, "Usage: %s [--worlds N] [--steps S] [--seed S] [--threads T]\n", argv[0]);
+            return 1;
+        }
+
+    LayoutParams params = makeLayoutParams(8, 6, 60);
+    WorldBatch batch(worlds, params, seed, threads);
+    std::vector<World> references(worlds);
+    for (int w = 0; w < worlds; w++)
+    {
+        references[w].seed(seed, w);
+        references[w].generateLayout(params);
+    }
+
+    // Drivers hold random inputs for a few steps, mostly forward.
+    static const int choices[8] = { INPUT_FORWARD, INPUT_FORWARD, INPUT_FORWARD, INPUT_TURN_LEFT,
+        INPUT_TURN_RIGHT, INPUT_BACKWARD, INPUT_BRAKE, INPUT_NONE };
+    std::mt19937 random(seed);
+    std::vector<int> inputs(worlds), held(worlds, 0), events(worlds);
+    int resets = 0, eventMisses = 0, stateMisses = 0, layoutMisses = 0;
+    for (int s = 0; s < steps; s++)
+    {
+        for (int w = 0; w < worlds; w++)
+            if (held[w]-- <= 0)
+            {
+                inputs[w] = choices[random() % 8];
+                held[w] = (int)(random() % HOLD_STEPS);
+            }
+        batch.step(inputs.data(), events.data());
+        for (int w = 0; w < worlds; w++)
+        {
+            int expected = references[w].step(inputs[w]);
+            const CarState& a = references[w].getState();
+            CarState b = batch.getState(w);
+            eventMisses += events[w] != expected;
+            stateMisses += a.x != b.x || a.z != b.z || a.angle != b.angle || a.speed != b.speed ||
+                a.isCollision != b.isCollision || a.isWin != b.isWin;
+            if (expected & EVENT_RESET)
+            {
+                resets++;
+                layoutMisses += !sameCubes(references[w].field.cubes, batch.getField(w).cubes);
+            }
+        }
+    }
+
+    printf("%d worlds, %d steps on %d threads: %d resets, %d event, %d state and %d layout mismatches\n", worlds,
+        steps, batch.getThreadCount(), resets, eventMisses, stateMisses, layoutMisses);
+    int failures = eventMisses + stateMisses + layoutMisses;
+    printf(failures ? "FAILED\n" : "passed\n");
+    return failures != 0;
+}
@@ -0,0 +1,242 @@
+// Bounding volume hierarchy over objects on the ground plane.
+#ifndef BVH_H
+#define BVH_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "collision.h"
+
+#define BVH_LEAF_SIZE 8 // Most objects held by a leaf, one batch of the widest kernel.
+#define BVH_STACK_SIZE 64 // Traversal stack depth, enough for any tree built by SphereBVH.
+
+// BVH node. Nodes are stored depth first in one array, so the first child of an
+// inner node is the next node and only the second child needs an index.
+struct BVHNode
+{
+    float minX, minZ, maxX, maxZ; // Bounds on the ground plane.
+    int start; // First object of a leaf, or index of the second child of an inner node.
+    int count; // Number of objects of a leaf, or 0 for an inner node.
+};
+
+// Static BVH over spheres on the ground plane, built once for a layout and then
+// only queried. Unlike UniformGrid its size depends only on the number of
+// objects, not on the area they spread over, so it suits sparse or irregular
+// layouts. Traversal uses a small explicit stack rather than recursion.
+class SphereBVH
+{
+public:
+    void build(const float* x, const float* z, const float* r, int count);
+    template <typename Visit>
+    int queryRanges(float minX, float minZ, float maxX, float maxZ, Visit visit) const;
+    template <typename Visit>
+    float raycast(float x, float z, float dirX, float dirZ, float maxDistance, Visit visit) const;
+    const std::vector<int>& getItems() const { return items; }
+    void markSorted();
+    int getNodeCount() const { return (int)nodes.size(); }
+    void write(BlockWriter& out) const { out.array(nodes.data(), nodes.size()); }
+    int read(BlockReader& in, int objects);
+
+private:
+    int buildNode(const float* x, const float* z, const float* r, int begin, int end);
+
+    MappedArray<BVHNode> nodes;
+    std::vector<int> items; // Object indices in leaf order, only kept while building.
+};
+
+// Function to build the tree over count objects centered at (x[k], z[k]) with
+// radius r[k]. Objects with radius 0 do not exist and are skipped.
+inline void SphereBVH::build(const float* x, const float* z, const float* r, int count)
+{
+    nodes.clear();
+    items.clear();
+    for (int k = 0; k < count; k++)
+        if (r[k] > 0)
+            items.push_back(k);
+    if (!items.empty())
+    {
+        nodes.reserve(2 * (items.size() / (BVH_LEAF_SIZE / 2) + 1));
+        buildNode(x, z, r, 0, (int)items.size());
+    }
+}
+
+// Function to build the subtree over items[begin .. end - 1] and return its root.
+// Splits at the median of the object centers along the longer axis.
+inline int SphereBVH::buildNode(const float* x, const float* z, const float* r, int begin, int end)
+{
+    int k, node = (int)nodes.size();
+    float centerMinX, centerMinZ, centerMaxX, centerMaxZ;
+    BVHNode bounds;
+
+    bounds.minX = bounds.minZ = 1.0e30f;
+    bounds.maxX = bounds.maxZ = -1.0e30f;
+    centerMinX = centerMinZ = 1.0e30f;
+    centerMaxX = centerMaxZ = -1.0e30f;
+    for (k = begin; k < end; k++)
+    {
+        int item = items[k];
+        bounds.minX = std::min(bounds.minX, x[item] - r[item]);
+        bounds.minZ = std::min(bounds.minZ, z[item] - r[item]);
+        bounds.maxX = std::max(bounds.maxX, x[item] + r[item]);
+        bounds.maxZ = std::max(bounds.maxZ, z[item] + r[item]);
+        centerMinX = std::min(centerMinX, x[item]);
+        centerMinZ = std::min(centerMinZ, z[item]);
+        centerMaxX = std::max(centerMaxX, x[item]);
+        centerMaxZ = std::max(centerMaxZ, z[item]);
+    }
+    bounds.start = begin;
+    bounds.count = end - begin;
+    nodes.push_back(bounds);
+    if (end - begin <= BVH_LEAF_SIZE)
+        return node;
+
+    int middle = begin + (end - begin) / 2;
+    if (centerMaxX - centerMinX >= centerMaxZ - centerMinZ)
+        std::nth_element(items.begin() + begin, items.begin() + middle, items.begin() + end,
+            [&](int a, int b) { return x[a] < x[b]; });
+    else
+        std::nth_element(items.begin() + begin, items.begin() + middle, items.begin() + end,
+            [&](int a, int b) { return z[a] < z[b]; });
+
+    buildNode(x, z, r, begin, middle); // First child is node + 1.
+    int second = buildNode(x, z, r, middle, end);
+    nodes[node].start = second;
+    nodes[node].count = 0;
+    return node;
+}
+
+// Function to record that the objects have been reordered into leaf order, so
+// that object k is now the one at position k of getItems().
+inline void SphereBVH::markSorted()
+{
+    for (int k = 0; k < (int)items.size(); k++)
+        items[k] = k;
+}
+
+// Function to read a tree written by write() over objects objects, already in
+// leaf order, from in. Returns 1 on success and 0 if the block does not hold
+// such a tree. Traversal trusts the nodes, so every node is checked even when not
+// verifying: every child must come after its parent and lie within the tree, every
+// leaf run must lie within the objects and the depth must fit the traversal stack.
+inline int SphereBVH::read(BlockReader& in, int objects)
+{
+    MappedArray<BVHNode> loaded;
+
+    if (!in.array(loaded))
+        return 0;
+    std::vector<int> depth(loaded.size(), 0);
+    for (size_t n = 0; n < depth.size(); n++)
+    {
+        const BVHNode& node = loaded.begin()[n];
+        if (depth[n] >= BVH_STACK_SIZE - 1)
+            return 0;
+        if (node.count > 0)
+        {
+            if (node.start < 0 || node.count > objects - node.start)
+                return 0;
+        }
+        else if (node.count < 0 || node.start <= (int)n + 1 || node.start >= (int)loaded.size())
+            return 0;
+        else
+        {
+            depth[n + 1] = std::max(depth[n + 1], depth[n] + 1);
+            depth[node.start] = std::max(depth[node.start], depth[n] + 1);
+        }
+    }
+    nodes = std::move(loaded);
+    items.clear();
+    return 1;
+}
+
+// Function to call visit(begin, end) with the object runs of every leaf that may
+// overlap the rectangle [minX, maxX] x [minZ, maxZ]. Runs index the objects in
+// leaf order (see buildCubeBVH()). Stops at and returns the first nonzero result.
+template <typename Visit>
+int SphereBVH::queryRanges(float minX, float minZ, float maxX, float maxZ, Visit visit) const
+{
+    int stack[BVH_STACK_SIZE], top = 0, result;
+
+    if (nodes.empty())
+        return 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const BVHNode& node = nodes[stack[--top]];
+        if (node.minX > maxX || node.maxX < minX || node.minZ > maxZ || node.maxZ < minZ)
+            continue;
+        if (node.count > 0)
+        {
+            if ((result = visit(node.start, node.start + node.count)) != 0)
+                return result;
+        }
+        else
+        {
+            stack[top++] = node.start;
+            stack[top++] = (int)(&node - &nodes[0]) + 1; // Visit the first child next.
+        }
+    }
+    return 0;
+}
+
+// Function to find the distance along the ray from (x, z) in the unit direction
+// (dirX, dirZ) to the nearest object, up to maxDistance. visit(begin, end, limit)
+// is called for each leaf the ray reaches before the nearest hit found so far
+// and must return the distance to the nearest of its objects that is closer than
+// limit, or limit. Returns maxDistance if nothing is hit.
+template <typename Visit>
+float SphereBVH::raycast(float x, float z, float dirX, float dirZ, float maxDistance, Visit visit) const
+{
+    int stack[BVH_STACK_SIZE], top = 0;
+    float invX = 1.0f / dirX, invZ = 1.0f / dirZ;
+
+    if (nodes.empty())
+        return maxDistance;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const BVHNode& node = nodes[stack[--top]];
+
+        // Slab test of the ray against the node bounds. A ray parallel to an axis
+        // either always or never lies within that slab.
+        float enter = 0.0f, exit = maxDistance;
+        if (dirX != 0.0f)
+        {
+            float t0 = (node.minX - x) * invX, t1 = (node.maxX - x) * invX;
+            enter = std::max(enter, std::min(t0, t1));
+            exit = std::min(exit, std::max(t0, t1));
+        }
+        else if (x < node.minX || x > node.maxX)
+            continue;
+        if (dirZ != 0.0f)
+        {
+            float t0 = (node.minZ - z) * invZ, t1 = (node.maxZ - z) * invZ;
+            enter = std::max(enter, std::min(t0, t1));
+            exit = std::min(exit, std::max(t0, t1));
+        }
+        else if (z < node.minZ || z > node.maxZ)
+            continue;
+        if (enter > exit)
+            continue;
+
+        if (node.count > 0)
+            maxDistance = visit(node.start, node.start + node.count, maxDistance);
+        else
+        {
+            stack[top++] = node.start;
+            stack[top++] = (int)(&node - &nodes[0]) + 1;
+        }
+    }
+    return maxDistance;
+}
+
+// Function to sort the cubes of store into leaf order and build bvh over them,
+// so that bvh.queryRanges() yields runs of consecutive cubes in the store.
+inline void buildCubeBVH(CubeStore& store, SphereBVH& bvh)
+{
+    bvh.build(store.getX(), store.getZ(), store.getR(), store.getCount());
+    store.permute(bvh.getItems().data(), (int)bvh.getItems().size());
+    bvh.markSorted();
+}
+
+#endif
@@ -1,30 +1,58 @@
 #define _USE_MATH_DEFINES
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h" 
+#include <chrono>
 #include <cstdlib>
 #include <cmath>
+#include <cstring>
+#include <ctime>
 #include <iostream>
+#include <memory>
 
 #include <glew.h>
 #include <freeglut.h> 
 
-#define ROWS 8  // Number of rows of cubes.
-#define COLUMNS 6 // Number of columns of cubes.
-#define FILL_PROBABILITY 100 // Percentage probability that a particular row-column slot will be 
+#include "world.h"
+#include "level.h"
+#include "replay.h"
+#include "timers.h"
+
+#define DEFAULT_ROWS 8  // Number of rows of cubes unless given on the command line.
+#define DEFAULT_COLUMNS 6 // Number of columns of cubes unless given on the command line.
+#define DEFAULT_FILL_PROBABILITY 100 // Percentage probability that a particular row-column slot will be 
 // filled with a cube. It should be an integer between 0 and 100.
+#define VIEW_DISTANCE 250.0 // Far plane of the viewing frustum; cubes beyond it are not drawn.
+#define GOAL_BOARD_OFFSET 5.0 // Distance of a goal board behind the center of its trigger area.
+#define SIM_STEP (1000.0 / STEPS_PER_SECOND) // Milliseconds of game time advanced by one world step.
+#define MAX_STEPS_PER_FRAME 8 // Most world steps run to catch up before a frame is drawn.
+#define DEFAULT_LEVEL_PATH "level.clvl" // Level file played, if present, when no layout is chosen.
+
+// Events of the game scheduled on the timer wheel of the world.
+#define TIMER_FRAME_COUNTER TIMER_FIRST_USER // Calls frameCounter() with the timer value.
 
 // Globals.
 static long font = (long)GLUT_BITMAP_8_BY_13; // Font selection.
 static int width, height; // Size of the OpenGL window.
-static float angle = 0.0; // Angle of the car.
-static float xVal = 0, zVal = 0; // Co-ordinates of the car.
-static int isCollision = 0; // Is there collision between the car and a cube?
+static World world; // Simulation state, advanced only through world.step().
+static LayoutParams layoutParams = makeLayoutParams(DEFAULT_ROWS, DEFAULT_COLUMNS,
+    DEFAULT_FILL_PROBABILITY); // Size and density of the layouts.
+static CarState previousState; // Car state before the last world step, drawn interpolated.
+static CarPose drawnPose = makeCarPose(0.0, 0.0, 0.0); // Pose of the car drawn last, rebuilt when it moves.
+static HeldInputs heldInputs; // Driving keys held down.
+static float accumulator = 0.0; // Game time in milliseconds not simulated yet.
+static int lastTime = 0; // Time in milliseconds at which advanceSimulation() last ran.
+static uint32_t simSteps = 0; // Number of world steps run so far.
+static uint64_t worldSeed; // Seed of the world's layouts.
+static InputRecorder recorder; // Key events of this game, if recording.
+static const char* recordPath = 0; // File to save the recorded events to on exit, or 0.
+static const char* levelPath = 0; // Level file played instead of generated layouts, or 0.
+static int streamChunks = 0; // Drive through an endless world of chunks instead of a layout?
+static std::unique_ptr<ChunkedWorld> chunks; // World of chunks streamed around the car, if streaming.
 static unsigned int car; // Display lists base index.
 static int frameCount = 0; // Number of frames
-static int isWin = 0; // Flag to check if the car has reached the goal.
 
-float light1Pos[] = { xVal + 20, 0.0, zVal, 1.0 }; // Spotlight position.
-float light2Pos[] = { xVal - 20, 0.0, zVal, 1.0 }; // Spotlight position.
+float light1Pos[] = { 20.0, 0.0, 0.0, 1.0 }; // Spotlight position.
+float light2Pos[] = { -20.0, 0.0, 0.0, 1.0 }; // Spotlight position.
 static float spotAngle = 20.0; // Spotlight cone half-angle.
 float spotDirection[] = { 0.0, 0.0, -1.0 }; // Spotlight direction.
 static float spotExponent = 10.0; // Spotlight attenuation exponent.
@@ -80,81 +108,72 @@ void writeBitmapString(void* font, char* string)
     for (c = string; *c != '\0'; c++) glutBitmapCharacter(font, *c);
 }
 
-// Cube class.
-class Cube
-{
-public:
-    Cube();
-    Cube(float x, float y, float z, float r, unsigned char colorR,
-        unsigned char colorG, unsigned char colorB);
-    float getCenterX() { return centerX; }
-    float getCenterY() { return centerY; }
-    float getCenterZ() { return centerZ; }
-    float getRadius() { return radius; }
-    void draw();
-
-private:
-    float centerX, centerY, centerZ, radius;
-    unsigned char color[3];
-};
-
-// Cube default constructor.
-Cube::Cube()
-{
-    centerX = 0.0;
-    centerY = 0.0;
-    centerZ = 0.0;
-    radius = 0.0; // Indicates no Cube exists in the position.
-    color[0] = 0;
-    color[1] = 0;
-    color[2] = 0;
-}
-
-// Cube constructor.
-Cube::Cube(float x, float y, float z, float r, unsigned char colorR,
-    unsigned char colorG, unsigned char colorB)
+// Function to draw the cubes of the chunks within VIEW_DISTANCE of a camera at
+// (x, z), each chunk with one call on the mesh built with it.
+void drawChunks(float x, float z)
 {
-    centerX = x;
-    centerY = y;
-    centerZ = z;
-    radius = r;
-    color[0] = colorR;
-    color[1] = colorG;
-    color[2] = colorB;
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    chunks->visitChunks(x - VIEW_DISTANCE, z - VIEW_DISTANCE, x + VIEW_DISTANCE, z + VIEW_DISTANCE,
+        [](const Chunk& chunk)
+        {
+            const ChunkMesh& mesh = chunk.mesh;
+            if (mesh.getVertexCount() == 0)
+                return;
+            glVertexPointer(3, GL_FLOAT, 6 * sizeof(float), mesh.vertices.data());
+            glNormalPointer(GL_FLOAT, 6 * sizeof(float), mesh.vertices.data() + 3);
+            glColorPointer(4, GL_UNSIGNED_BYTE, 0, mesh.colors.data());
+            glDrawArrays(GL_QUADS, 0, mesh.getVertexCount());
+        });
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
 }
 
-// Function to draw a cube.
-void Cube::draw()
+// Function to draw the cubes within VIEW_DISTANCE of a camera at (x, z). Only the
+// cubes the broad-phase finds around the camera are visited, so large maps cost
+// no more per frame than small ones.
+void drawCubes(float x, float z)
 {
-    if (radius > 0.0) // If Cube exists.
+    if (chunks)
     {
-        glPushMatrix();
-        glTranslatef(centerX, centerY, centerZ); // Position the cube.
-        glColor3ubv(color); // Set the color.
-        float size = radius * 2; // Use radius as half the cube's size.
-        glutSolidCube(size); // Draw a solid cube with edge length equal to size.
-        glPopMatrix();
+        drawChunks(x, z);
+        return;
     }
-}
-
 
-Cube arrayCubes[ROWS][COLUMNS]; // Global array of cubes.
+    const ObstacleField& field = world.field;
+    field.queryCubes(x - VIEW_DISTANCE, z - VIEW_DISTANCE, x + VIEW_DISTANCE, z + VIEW_DISTANCE,
+        [&](int begin, int end)
+        {
+            for (int k = begin; k < end; k++)
+            {
+                glPushMatrix();
+                glTranslatef(field.cubes.getX()[k], field.cubes.getY()[k], field.cubes.getZ()[k]); // Position the cube.
+                glColor3ubv(field.cubes.getColor(k)); // Set the color.
+                float size = field.cubes.getR()[k] * 2; // Use radius as half the cube's size.
+                glutSolidCube(size); // Draw a solid cube with edge length equal to size.
+                glPopMatrix();
+            }
+            return 0;
+        });
+}
 
-// Routine to count the number of frames drawn every second.
+// Routine to count the number of frames drawn every second of game time.
 void frameCounter(int value)
 {
     if (value != 0) // No output the first time frameCounter() is called (from main()).
         std::cout << "FPS = " << frameCount << std::endl;
     frameCount = 0;
-    glutTimerFunc(1000, frameCounter, 1);
+    world.getTimers().schedule(STEPS_PER_SECOND, TIMER_FRAME_COUNTER, 1, 1);
 }
 
 
-// Initialization routine.
+// Initialization routine. Loads the textures and sets up the display list and
+// lights once for the whole run; resets of the game do not come back here.
 void setup(void)
 {
     glClearColor(0.0, 0.0, 0.0, 0.0);
-    int i, j;
 
     glEnable(GL_TEXTURE_2D); // Enable 2D texturing
     // Load the textures for the sky and ground
@@ -172,20 +191,6 @@ void setup(void)
     glPopMatrix();
     glEndList();
 
-    // Initialize global arraycubes.
-    for (j = 0; j < COLUMNS; j++)
-        for (i = 0; i < ROWS; i++)
-            if (rand() % 100 < FILL_PROBABILITY)
-            {
-                // Position the cubes depending on if there is an even or odd number of columns
-                if (COLUMNS % 2) // Odd number of columns.
-                    arrayCubes[i][j] = Cube(30.0 * (-COLUMNS / 2 + j), 0.0, -40.0 - 30.0 * i, 3.0,
-                        rand() % 256, rand() % 256, rand() % 256);
-                else // Even number of columns.
-                    arrayCubes[i][j] = Cube(15 + 30.0 * (-COLUMNS / 2 + j), 0.0, -40.0 - 30.0 * i, 3.0,
-                        rand() % 256, rand() % 256, rand() % 256);
-            }
-
     glEnable(GL_DEPTH_TEST);
 
     // Turn on OpenGL lighting.
@@ -238,48 +243,12 @@ void setup(void)
 }
 
 
-// Function to check if two spheres centered at (x1,y1,z1) and (x2,y2,z2) with
-// radius r1 and r2 intersect.
-int checkSpheresIntersection(float x1, float y1, float z1, float r1,
-    float x2, float y2, float z2, float r2)
-{
-    return ((x1 - x2) * (x1 - x2) + (y1 - y2) * (y1 - y2) + (z1 - z2) * (z1 - z2) <= (r1 + r2) * (r1 + r2));
-}
-
-// Function to check if the car collides with a cube when the center of the base
-// of the car is at (x, 0, z) and it is aligned at an angle a to to the -z direction.
-// Collision detection is approximate as instead of the car we use a bounding sphere.
-int cubeCarCollision(float x, float z, float a)
-{
-    int i, j;
-
-    // Check for collision with each cube.
-    for (j = 0; j < COLUMNS; j++)
-        for (i = 0; i < ROWS; i++)
-            if (arrayCubes[i][j].getRadius() > 0) // If cube exists.
-                if (checkSpheresIntersection(x - 5 * sin((M_PI / 180.0) * a), 0.0,
-                    z - 5 * cos((M_PI / 180.0) * a), 7.072,
-                    arrayCubes[i][j].getCenterX(), arrayCubes[i][j].getCenterY(),
-                    arrayCubes[i][j].getCenterZ(), arrayCubes[i][j].getRadius()))
-                    return 1;
-    return 0;
-}
-
-int goalCollision(float x, float z)
-{
-    // Goal position and size (center at (3.0, 0.0, -100.0) with a radius)
-    float goalX = 3.0, goalZ = -95.0, goalRadius = 10.0;
-
-    // Check if the car's bounding sphere intersects the goal
-    return ((x - goalX) * (x - goalX) + (z - goalZ) * (z - goalZ) <= goalRadius * goalRadius);
-}
-
-
-void drawGoal(void)
+// Function to draw a goal board centered at (x, 0, z).
+void drawGoal(float x, float z)
 {
     // Draw a white box with a black circle on it
     glPushMatrix();
-    glTranslatef(3.0, 0.0, -100.0); // Position the box in the scene
+    glTranslatef(x, 0.0, z); // Position the box in the scene
     glScalef(15.0, 15.0, 5.0); // Scale to make it rectangular
     glColor3f(1.0, 1.0, 1.0); // White color for the box
     glutSolidCube(1.0); // Draw the white box
@@ -338,16 +307,45 @@ void drawGoal(void)
 
     glPopMatrix();
 }
-void drawCar(void)
+// Function to draw all the trigger areas: a board for each goal and a ring on the
+// ground for each checkpoint and hazard.
+void drawTriggers(void)
+{
+    const ObstacleField& field = world.field;
+    for (int k = 0; k < field.triggers.getCount(); k++)
+    {
+        float x = field.triggers.getX()[k], z = field.triggers.getZ()[k];
+        if (field.triggers.getType(k) == TRIGGER_GOAL)
+        {
+            drawGoal(x, z - GOAL_BOARD_OFFSET);
+            continue;
+        }
+
+        glPushMatrix();
+        glTranslatef(x, -0.75, z); // Lay the ring at the bottom of the car body.
+        glRotatef(90.0, 1.0, 0.0, 0.0);
+        if (field.triggers.getType(k) == TRIGGER_HAZARD)
+            glColor3f(1.0, 0.0, 0.0); // Red for hazards.
+        else if (world.isTriggerReached(k))
+            glColor3f(0.0, 1.0, 0.0); // Green for checkpoints already reached.
+        else
+            glColor3f(1.0, 1.0, 0.0); // Yellow for checkpoints still to reach.
+        glutSolidTorus(0.3, field.triggers.getR()[k], 8, 40);
+        glPopMatrix();
+    }
+}
+
+// Function to draw the car in the given pose.
+void drawCar(const CarPose& pose)
 {
     // Draw car
     glPushMatrix();
 
     // Position the car
-    glTranslatef(xVal, 0.0, zVal);
+    glTranslatef(pose.x, 0.0, pose.z);
 
     // Rotate the car based on angle
-    glRotatef(angle, 0.0, 1.0, 0.0);
+    glRotatef(pose.angle, 0.0, 1.0, 0.0);
 
     // Draw car body
     glPushMatrix();
@@ -383,20 +381,15 @@ void drawCar(void)
     glPopMatrix();
 }
 
-void resetGame(int value)
+// Routine run after world.step() has reset the world, RESET_DELAY_STEPS after a
+// win or loss. The world has generated a new layout unless a level file or the
+// world of chunks is played, which is played again instead. No textures, lists
+// or other GL resources are touched: the cubes are drawn straight from the
+// layout. Prints how long the step with the reset took.
+void resetGame(double milliseconds)
 {
-    // Reset car's position and angle.
-    xVal = 0.0;
-    zVal = 0.0;
-    angle = 0.0;
-
-    // Reset collision flag.
-    isCollision = 0;
-    isWin = 0;
-
-    // Optionally, regenerate cubes or keep the same layout.
-    setup();
-
+    previousState = world.getState();
+    std::cout << (levelPath || chunks ? "Reset" : "New layout") << " in " << milliseconds << " ms" << std::endl;
     glutPostRedisplay();
 }
 
@@ -489,8 +482,15 @@ void drawGround() {
 // Drawing routine.
 void drawScene(void)
 {
+    // Draw the car part of the way from the previous to the current step, by the
+    // game time not simulated yet.
+    CarState state = interpolateState(previousState, world.getState(), accumulator / SIM_STEP);
+    if (state.x != drawnPose.x || state.z != drawnPose.z || state.angle != drawnPose.angle)
+        drawnPose = makeCarPose(state.x, state.z, state.angle);
+    const CarPose& pose = drawnPose;
+    float xVal = pose.x, zVal = pose.z;
+
     frameCount++; // Increment number of frames every redraw.
-    int i, j;
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // Begin left viewport.
@@ -503,11 +503,11 @@ void drawScene(void)
     glRasterPos3f(-28.0, 25.0, -30.0);
 
     // Draw win/lose message
-    if (isCollision)
+    if (state.isCollision)
     {
         drawWinLoseMessage("You Lose!");
     }
-    else if (isWin)
+    else if (state.isWin)
     {
         drawWinLoseMessage("You Win!");
     }
@@ -529,8 +529,8 @@ void drawScene(void)
     light2Pos[0] = xVal - 20;
     light2Pos[2] = zVal;
 
-    spotDirection[0] = -sin((M_PI / 180.0) * angle);
-    spotDirection[2] = -cos((M_PI / 180.0) * angle);
+    spotDirection[0] = pose.headingX;
+    spotDirection[2] = pose.headingZ;
 
 
 
@@ -548,12 +548,10 @@ void drawScene(void)
 
     glPopMatrix();
 
-    // Draw all the cubes in arraycubes.
-    for (j = 0; j < COLUMNS; j++)
-        for (i = 0; i < ROWS; i++)
-            arrayCubes[i][j].draw();
-    drawCar();
-    drawGoal();
+    // Draw the cubes in view of the fixed camera.
+    drawCubes(0.0, 20.0);
+    drawCar(pose);
+    drawTriggers();
 
     glPopAttrib();  // Restore the previous settings
     //glEnable(GL_TEXTURE_2D);
@@ -593,12 +591,12 @@ void drawScene(void)
     glLineWidth(1.0);
 
     // Locate the camera at the tip of the cone and pointing in the direction of the cone.
-    gluLookAt(xVal - 10 * sin((M_PI / 180.0) * angle),
+    gluLookAt(xVal + 10 * pose.headingX,
         0.0,
-        zVal - 10 * cos((M_PI / 180.0) * angle),
-        xVal - 11 * sin((M_PI / 180.0) * angle),
+        zVal + 10 * pose.headingZ,
+        xVal + 11 * pose.headingX,
         0.0,
-        zVal - 11 * cos((M_PI / 180.0) * angle),
+        zVal + 11 * pose.headingZ,
         0.0,
         1.0,
         0.0);
@@ -606,13 +604,13 @@ void drawScene(void)
     glPushMatrix();
 
     // Update spotlight positions and directions based on car's position and orientation.
-    light1Pos[0] = xVal + 20.0 + 1.0 * cos((M_PI / 180.0) * angle);
-    light1Pos[2] = zVal + 1.0 * sin((M_PI / 180.0) * angle);
-    light2Pos[0] = xVal - 20.0 - 1.0 * cos((M_PI / 180.0) * angle);
-    light2Pos[2] = zVal - 1.0 * sin((M_PI / 180.0) * angle);
+    light1Pos[0] = xVal + 20.0 - 1.0 * pose.headingZ;
+    light1Pos[2] = zVal - 1.0 * pose.headingX;
+    light2Pos[0] = xVal - 20.0 + 1.0 * pose.headingZ;
+    light2Pos[2] = zVal + 1.0 * pose.headingX;
 
-    spotDirection[0] = -sin((M_PI / 180.0) * angle);
-    spotDirection[2] = -cos((M_PI / 180.0) * angle);
+    spotDirection[0] = pose.headingX;
+    spotDirection[2] = pose.headingZ;
 
     // Spotlight position.
     glLightfv(GL_LIGHT0, GL_POSITION, light1Pos);
@@ -627,12 +625,10 @@ void drawScene(void)
 
     glPopMatrix();
 
-    // Draw all the cubes in arraycubes.
-    for (j = 0; j < COLUMNS; j++)
-        for (i = 0; i < ROWS; i++)
-            arrayCubes[i][j].draw();
+    // Draw the cubes in view of the car.
+    drawCubes(xVal, zVal);
 
-    drawGoal();
+    drawTriggers();
 
     glPopAttrib();  // Restore the previous texture settings
  /*   glEnable(GL_TEXTURE_2D);*/
@@ -665,13 +661,41 @@ void resize(int w, int h)
     height = h;
 }
 
+// Function to hold down the driving key for input, recording it if recording.
+void pressInput(int input)
+{
+    if (input == INPUT_NONE)
+        return;
+    heldInputs.press(input);
+    if (recordPath)
+        recorder.record(simSteps, LOG_KEY_DOWN, input);
+}
+
+// Function to release the driving key for input, recording it if recording.
+void releaseInput(int input)
+{
+    if (input == INPUT_NONE)
+        return;
+    heldInputs.release(input);
+    if (recordPath)
+        recorder.record(simSteps, LOG_KEY_UP, input);
+}
+
 // Keyboard input processing routine.
 void keyInput(unsigned char key, int x, int y)
 {
+    if (key == ' ')
+    {
+        pressInput(INPUT_BRAKE);
+        return;
+    }
+    if (recordPath)
+        recorder.record(simSteps, LOG_KEY, key);
+
     switch (key)
     {
     case 27:
-        exit(0);
+        exit(0); // Saves the recording, if any, through atexit().
         break;
     case 'g': // Toggle between groundTextureID1 and groundTextureID2
         if (groundTextureIDcurrent == groundTextureID1)
@@ -685,47 +709,70 @@ void keyInput(unsigned char key, int x, int y)
     }
 }
 
-// Callback routine for non-ASCII key entry.
+// Keyboard release processing routine.
+void keyUp(unsigned char key, int x, int y)
+{
+    if (key == ' ')
+        releaseInput(INPUT_BRAKE);
+}
+
+// Function returning the INPUT_* value for a special key, or INPUT_NONE.
+int keyToInput(int key)
+{
+    switch (key)
+    {
+    case GLUT_KEY_LEFT: return INPUT_TURN_LEFT;
+    case GLUT_KEY_RIGHT: return INPUT_TURN_RIGHT;
+    case GLUT_KEY_UP: return INPUT_FORWARD;
+    case GLUT_KEY_DOWN: return INPUT_BACKWARD;
+    default: return INPUT_NONE;
+    }
+}
+
+// Callback routine for non-ASCII key press. The key only becomes held, the car
+// is driven by the held keys in advanceSimulation().
 void specialKeyInput(int key, int x, int y)
 {
-    if (isCollision || isWin)
-        return; // Block all movement inputs during collision.
+    pressInput(keyToInput(key));
+}
 
-    float tempxVal = xVal, tempzVal = zVal, tempAngle = angle;
+// Callback routine for non-ASCII key release.
+void specialKeyUp(int key, int x, int y)
+{
+    releaseInput(keyToInput(key));
+}
 
-    switch (key)
+// Routine to run the game event of a timer of the world's wheel that came due.
+void fireTimer(int event, int value)
+{
+    switch (event)
     {
-    case GLUT_KEY_LEFT: tempxVal = xVal; tempAngle += 5.0; break;
-    case GLUT_KEY_RIGHT: tempxVal = xVal; tempAngle -= 5.0; break;
-    case GLUT_KEY_UP:
-        tempxVal -= sin(angle * M_PI / 180.0);
-        tempzVal -= cos(angle * M_PI / 180.0);
-        break;
-    case GLUT_KEY_DOWN:
-        tempxVal += sin(angle * M_PI / 180.0);
-        tempzVal += cos(angle * M_PI / 180.0);
-        break;
+    case TIMER_FRAME_COUNTER: frameCounter(value); break;
     default: break;
     }
+}
 
-    // Check for collisions and only update position if no collision occurs.
-    if (!cubeCarCollision(tempxVal, tempzVal, tempAngle))
-    {
-        xVal = tempxVal;
-        zVal = tempzVal;
-        angle = tempAngle;
+// Idle callback routine. Steps the world at a fixed rate of one step per SIM_STEP
+// of elapsed time, however often it is called, and redraws. After a stall at
+// most MAX_STEPS_PER_FRAME steps are run and the rest of the backlog is dropped.
+void advanceSimulation(void)
+{
+    int now = glutGet(GLUT_ELAPSED_TIME), steps = 0;
 
-        if (goalCollision(xVal, zVal))
-        {
-            isWin = 1; // Set win flag
-            glutTimerFunc(3000, resetGame, 0); // Restart game after 3 seconds
-        }
-    }
-    else
+    accumulator += now - lastTime;
+    lastTime = now;
+    while (accumulator >= SIM_STEP && steps < MAX_STEPS_PER_FRAME)
     {
-        isCollision = 1; // Set collision flag.
-        glutTimerFunc(3000, resetGame, 0); // Reset game after 3 seconds.
+        previousState = world.getState();
+        auto start = std::chrono::steady_clock::now();
+        if (world.step(heldInputs.getControls()) & EVENT_RESET)
+            resetGame(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        accumulator -= SIM_STEP;
+        simSteps++;
+        steps++;
     }
+    if (accumulator >= SIM_STEP)
+        accumulator = fmod(accumulator, SIM_STEP);
 
     glutPostRedisplay();
 }
@@ -735,15 +782,72 @@ void specialKeyInput(int key, int x, int y)
 void printInteraction(void)
 {
     std::cout << "Interaction:" << std::endl;
-    std::cout << "Press the left/right arrow keys to turn the Car." << std::endl
-        << "Press the up/down arrow keys to move the Car." << std::endl;
+    std::cout << "Hold the left/right arrow keys to steer the Car." << std::endl
+        << "Hold the up/down arrow keys to accelerate forward/backward." << std::endl
+        << "Hold the space bar to brake." << std::endl;
+}
+
+// Routine to save the recorded key events when the program exits.
+void saveRecording(void)
+{
+    if (!recorder.save(recordPath, simSteps, world.getState()))
+        std::cerr << "Failed to save recording: " << recordPath << std::endl;
+    else
+        std::cout << "Recorded " << recorder.getEventCount() << " events over " << simSteps
+            << " steps to " << recordPath << std::endl;
 }
 
-// Main routine.
+// Main routine. With --record <file>, the key events of the game are saved to file
+// on exit for headless replay. With --level <file>, the level file is played.
+// With --stream, the car drives through an endless world of chunks generated
+// around it with the spacing and fill of the layout options. Otherwise layouts
+// are generated, their size and density set with --size RxC, --rows, --columns,
+// --spacing and --fill, or read from --layout <file>. Given none of these, the
+// level file DEFAULT_LEVEL_PATH is played if present; level_tool compile makes it
+// from a text level such as level.json.
 int main(int argc, char** argv)
 {
     printInteraction();
     glutInit(&argc, argv);
+    int n, layoutGiven = 0;
+    for (n = 1; n < argc; n++)
+        if (!strcmp(argv[n], "--record") && n + 1 < argc)
+            recordPath = argv[++n];
+        else if (!strcmp(argv[n], "--level") && n + 1 < argc)
+            levelPath = argv[++n];
+        else if (!strcmp(argv[n], "--stream"))
+            streamChunks = 1;
+        else if (parseLayoutOption(n, argc, argv, layoutParams))
+            layoutGiven = 1;
+        else
+            break;
+    if (n < argc || (levelPath && streamChunks))
+    {
+        std::cerr << "Usage: " << argv[0] << " [--record <file>] [--level <file> | --stream] [--size RxC]"
+            " [--rows R] [--columns C] [--spacing D] [--fill P] [--layout <file>]" << std::endl;
+        return 1;
+    }
+    if (!checkLayoutParams(layoutParams))
+    {
+        std::cerr << "Invalid layout: " << layoutParams.rows << " x " << layoutParams.columns << " slots "
+            << layoutParams.spacing << " apart, " << layoutParams.fillProbability << "% filled" << std::endl;
+        return 1;
+    }
+    if (!levelPath && !streamChunks && !layoutGiven)
+    {
+        // Play the compiled default level if there is one, else generate as asked.
+        FILE* file = fopen(DEFAULT_LEVEL_PATH, "rb");
+        if (file)
+        {
+            fclose(file);
+            levelPath = DEFAULT_LEVEL_PATH;
+        }
+    }
+    if (levelPath && !world.loadLevel(levelPath))
+    {
+        std::cerr << "Failed to load level file: " << levelPath << std::endl;
+        return 1;
+    }
 
     glutInitContextVersion(3, 3);
     glutInitContextProfile(GLUT_COMPATIBILITY_PROFILE);
@@ -755,12 +859,34 @@ int main(int argc, char** argv)
     glutDisplayFunc(drawScene);
     glutReshapeFunc(resize);
     glutKeyboardFunc(keyInput);
+    glutKeyboardUpFunc(keyUp);
     glutSpecialFunc(specialKeyInput);
+    glutSpecialUpFunc(specialKeyUp);
+    glutIgnoreKeyRepeat(1); // Held keys are tracked, so key repeat events are not needed.
+    glutIdleFunc(advanceSimulation);
 
     glewExperimental = GL_TRUE;
     glewInit();
 
+    worldSeed = (uint64_t)time(0); // A different series of layouts every run.
+    world.seed(worldSeed);
+    world.setTimerHandler(fireTimer);
+    if (streamChunks)
+    {
+        chunks.reset(new ChunkedWorld(worldSeed, layoutParams));
+        world.setChunks(chunks.get());
+    }
+    if (recordPath)
+    {
+        recorder.begin(worldSeed, layoutParams, levelPath != 0, streamChunks);
+        atexit(saveRecording);
+    }
     setup();
+    if (!levelPath && !streamChunks)
+        world.generateLayout(layoutParams);
+    previousState = world.getState();
+    frameCounter(0);
+    lastTime = glutGet(GLUT_ELAPSED_TIME);
 
     glutMainLoop();
 }
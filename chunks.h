@@ -0,0 +1,324 @@
+// Endless world split into square chunks of cubes, generated around the car on a
+// background thread and evicted once the car has left them far behind.
+#ifndef CHUNKS_H
+#define CHUNKS_H
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "obstacles.h"
+
+#define CHUNK_SLOTS 8 // Cube slots along each edge of a chunk.
+#define CHUNK_NEAR_RADIUS 1 // Chunks around the car's chunk that must be in place before a step.
+#define CHUNK_LOAD_RADIUS 2 // Chunks around the car's chunk generated in the background.
+#define CHUNK_EVICT_RADIUS 3 // Chunks further than this from the car's chunk are evicted.
+#define CHUNK_START_CLEARANCE 20.0f // No cube is placed this close to the start of the car.
+#define CUBE_MESH_VERTICES 24 // Vertices drawn per cube: four for each of its six faces.
+
+// Cubes of a chunk as one batch of quads ready to be drawn with a single call:
+// a position and a normal for each vertex, and its color.
+struct ChunkMesh
+{
+    std::vector<float> vertices; // x, y, z, nx, ny, nz of each vertex.
+    std::vector<unsigned char> colors; // Red, green, blue and alpha of each vertex.
+    int getVertexCount() const { return (int)colors.size() / 4; }
+};
+
+// One chunk of the world: the cubes in the square of edge CHUNK_SLOTS slots whose
+// corner of least x and z is (chunkX, chunkZ) chunks from the origin, with their
+// collision structures and the batch they are drawn with.
+struct Chunk
+{
+    int chunkX, chunkZ; // Position of the chunk in chunks.
+    ObstacleField field; // Cubes of the chunk, built.
+    ChunkMesh mesh; // Cubes of the chunk, to draw.
+};
+
+// Function to add the quads of the cube of half edge r centered at (x, y, z) with
+// the given color to mesh.
+inline void addCubeToMesh(ChunkMesh& mesh, float x, float y, float z, float r, const unsigned char* color)
+{
+    // Corners of each face, counterclockwise seen from outside, after its normal.
+    static const signed char faces[6][5][3] = {
+        { { 1, 0, 0 }, { 1, -1, 1 }, { 1, -1, -1 }, { 1, 1, -1 }, { 1, 1, 1 } },
+        { { -1, 0, 0 }, { -1, -1, -1 }, { -1, -1, 1 }, { -1, 1, 1 }, { -1, 1, -1 } },
+        { { 0, 1, 0 }, { -1, 1, 1 }, { 1, 1, 1 }, { 1, 1, -1 }, { -1, 1, -1 } },
+        { { 0, -1, 0 }, { -1, -1, -1 }, { 1, -1, -1 }, { 1, -1, 1 }, { -1, -1, 1 } },
+        { { 0, 0, 1 }, { -1, -1, 1 }, { 1, -1, 1 }, { 1, 1, 1 }, { -1, 1, 1 } },
+        { { 0, 0, -1 }, { 1, -1, -1 }, { -1, -1, -1 }, { -1, 1, -1 }, { 1, 1, -1 } }
+    };
+
+    for (int f = 0; f < 6; f++)
+        for (int v = 1; v <= 4; v++)
+        {
+            const signed char* corner = faces[f][v], * normal = faces[f][0];
+            float vertex[6] = { x + r * corner[0], y + r * corner[1], z + r * corner[2],
+                (float)normal[0], (float)normal[1], (float)normal[2] };
+            mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + 6);
+            mesh.colors.insert(mesh.colors.end(), color, color + 3);
+            mesh.colors.push_back(255);
+        }
+}
+
+// World of chunks generated with the spacing and fill probability of a layout
+// around wherever the car drives; the rows and columns of the layout are not
+// used. Each chunk depends only on the seed and its position, so a chunk that was
+// evicted comes back the same when the car returns, and two worlds with the same
+// seed are the same however their chunks were generated.
+// update() is called from the simulation thread with the car's position before
+// each step. It swaps in the chunks the worker thread has finished, evicts the
+// chunks beyond CHUNK_EVICT_RADIUS, so at most (2 CHUNK_EVICT_RADIUS + 1)^2 are
+// ever kept, and asks the worker for the missing chunks within CHUNK_LOAD_RADIUS,
+// nearest first. The worker builds the collision structures and the mesh of each
+// chunk, so swapping a chunk in is a pointer move. Only if the car gets within
+// CHUNK_NEAR_RADIUS of a chunk the worker has not delivered, as after a reset far
+// from the start, is that chunk generated in update() itself; since collision
+// queries never reach past it, what the car hits does not depend on the timing of
+// the worker.
+// Chunks hold cubes only, with no goals, checkpoints or hazards, so a streamed
+// world is driven without an end: triggerCollision() never reports a trigger.
+class ChunkedWorld
+{
+public:
+    ChunkedWorld(uint64_t seed, const LayoutParams& params);
+    ~ChunkedWorld();
+    int update(float x, float z);
+    float sweptCubeCarCollision(const CarPose& from, const CarPose& to) const;
+    int triggerCollision(float, float, unsigned char*) const { return 0; } // Chunks hold no triggers.
+    template <typename Visit>
+    void visitChunks(float minX, float minZ, float maxX, float maxZ, Visit visit) const;
+    int getChunkCount() const { return (int)resident.size(); }
+    float getChunkSize() const { return chunkSize; }
+
+private:
+    ChunkedWorld(const ChunkedWorld&) = delete;
+    ChunkedWorld& operator=(const ChunkedWorld&) = delete;
+    std::unique_ptr<Chunk> generateChunk(int chunkX, int chunkZ) const;
+    int findChunk(int chunkX, int chunkZ) const;
+    void requestChunks();
+    void work();
+
+    const uint64_t seed; // Seed of every chunk, each drawing from its own stream.
+    const LayoutParams params; // Spacing and fill probability of the cube slots.
+    const float chunkSize; // Edge length of a chunk.
+    std::vector<std::unique_ptr<Chunk>> resident; // Chunks in use, touched by the simulation thread only.
+    int centerX, centerZ; // Chunk the car was in at the last update().
+    int hasCenter; // Has update() been called yet?
+
+    std::mutex mutex; // Guards the members below, shared with the worker.
+    std::condition_variable wake; // Signalled when there are requests or the worker should stop.
+    std::vector<std::pair<int, int>> requests; // Chunks to generate, the nearest last.
+    std::vector<std::unique_ptr<Chunk>> ready; // Chunks generated but not swapped in yet.
+    std::pair<int, int> busy; // Chunk the worker is generating, if working.
+    int working; // Is the worker generating a chunk?
+    int stopping; // Should the worker exit?
+    std::thread worker;
+};
+
+// ChunkedWorld constructor. Starts the worker, which waits for the first update().
+inline ChunkedWorld::ChunkedWorld(uint64_t seed, const LayoutParams& params) :
+    seed(seed), params(params), chunkSize(CHUNK_SLOTS * params.spacing)
+{
+    centerX = centerZ = 0;
+    hasCenter = 0;
+    working = 0;
+    stopping = 0;
+    worker = std::thread(&ChunkedWorld::work, this);
+}
+
+// ChunkedWorld destructor. Waits for the worker to finish the chunk it is on.
+inline ChunkedWorld::~ChunkedWorld()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = 1;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+// Function returning the chunk at (chunkX, chunkZ), generated from scratch. Each
+// slot is filled like a slot of generateLayout(), from the stream of the chunk.
+inline std::unique_ptr<Chunk> ChunkedWorld::generateChunk(int chunkX, int chunkZ) const
+{
+    std::unique_ptr<Chunk> chunk(new Chunk());
+    Pcg32 random(seed, (uint64_t)(uint32_t)chunkX << 32 | (uint32_t)chunkZ);
+    int i, j;
+
+    chunk->chunkX = chunkX;
+    chunk->chunkZ = chunkZ;
+    chunk->field.cubes.reserve(CHUNK_SLOTS * CHUNK_SLOTS);
+    for (j = 0; j < CHUNK_SLOTS; j++)
+        for (i = 0; i < CHUNK_SLOTS; i++)
+            if ((int)random.nextBelow(100) < params.fillProbability)
+            {
+                // Draw the color one component at a time, so the order is fixed.
+                unsigned char color[3];
+                color[0] = random.nextBelow(256);
+                color[1] = random.nextBelow(256);
+                color[2] = random.nextBelow(256);
+
+                // Slots are centered in their square, so every cube lies inside its chunk.
+                float x = params.spacing * (chunkX * CHUNK_SLOTS + j + 0.5f);
+                float z = params.spacing * (chunkZ * CHUNK_SLOTS + i + 0.5f);
+                if (hypot(x, z) < CHUNK_START_CLEARANCE)
+                    continue;
+                chunk->field.cubes.add(x, 0.0, z, CUBE_RADIUS, color[0], color[1], color[2]);
+                addCubeToMesh(chunk->mesh, x, 0.0, z, CUBE_RADIUS, color);
+            }
+
+    // Chunks are small and many, like the worlds of a batch, so no distance
+    // fields are baked for them.
+    chunk->field.bakeDistanceField = 0;
+    chunk->field.build(1);
+    return chunk;
+}
+
+// Function returning the index in resident of the chunk at (chunkX, chunkZ), or -1.
+inline int ChunkedWorld::findChunk(int chunkX, int chunkZ) const
+{
+    for (int k = 0; k < (int)resident.size(); k++)
+        if (resident[k]->chunkX == chunkX && resident[k]->chunkZ == chunkZ)
+            return k;
+    return -1;
+}
+
+// Function to bring the chunks around the car at (x, z) up to date: swap in the
+// chunks the worker has finished, evict those too far away, generate any missing
+// chunk within CHUNK_NEAR_RADIUS and ask the worker for the rest. Returns the
+// number of chunks swapped in or generated.
+inline int ChunkedWorld::update(float x, float z)
+{
+    int chunkX = (int)floor(x / chunkSize), chunkZ = (int)floor(z / chunkSize), added = 0, k, i, j;
+    std::vector<std::unique_ptr<Chunk>> finished;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.swap(ready);
+    }
+    // Keep the chunks still in range that are not in place already; a chunk can be
+    // finished twice if it was also generated here while the worker was on it.
+    for (std::unique_ptr<Chunk>& chunk : finished)
+        if (abs(chunk->chunkX - chunkX) <= CHUNK_EVICT_RADIUS && abs(chunk->chunkZ - chunkZ) <= CHUNK_EVICT_RADIUS &&
+            findChunk(chunk->chunkX, chunk->chunkZ) < 0)
+        {
+            resident.push_back(std::move(chunk));
+            added++;
+        }
+
+    for (k = 0; k < (int)resident.size();)
+        if (abs(resident[k]->chunkX - chunkX) > CHUNK_EVICT_RADIUS || abs(resident[k]->chunkZ - chunkZ) > CHUNK_EVICT_RADIUS)
+        {
+            resident[k] = std::move(resident.back());
+            resident.pop_back();
+        }
+        else
+            k++;
+
+    int generated = 0;
+    for (j = chunkZ - CHUNK_NEAR_RADIUS; j <= chunkZ + CHUNK_NEAR_RADIUS; j++)
+        for (i = chunkX - CHUNK_NEAR_RADIUS; i <= chunkX + CHUNK_NEAR_RADIUS; i++)
+            if (findChunk(i, j) < 0)
+            {
+                resident.push_back(generateChunk(i, j));
+                generated++;
+            }
+
+    if (!hasCenter || chunkX != centerX || chunkZ != centerZ || generated)
+    {
+        centerX = chunkX;
+        centerZ = chunkZ;
+        hasCenter = 1;
+        requestChunks();
+    }
+    return added + generated;
+}
+
+// Function to replace the requests of the worker with the chunks within
+// CHUNK_LOAD_RADIUS of the center that are neither in place nor being generated,
+// so chunks the car has driven away from before they were reached are dropped.
+inline void ChunkedWorld::requestChunks()
+{
+    std::vector<std::pair<int, int>> missing;
+
+    for (int j = centerZ - CHUNK_LOAD_RADIUS; j <= centerZ + CHUNK_LOAD_RADIUS; j++)
+        for (int i = centerX - CHUNK_LOAD_RADIUS; i <= centerX + CHUNK_LOAD_RADIUS; i++)
+            if (findChunk(i, j) < 0)
+                missing.push_back(std::make_pair(i, j));
+    std::sort(missing.begin(), missing.end(), [&](const std::pair<int, int>& a, const std::pair<int, int>& b)
+        {
+            return std::max(abs(a.first - centerX), abs(a.second - centerZ)) >
+                std::max(abs(b.first - centerX), abs(b.second - centerZ));
+        });
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (working)
+            missing.erase(std::remove(missing.begin(), missing.end(), busy), missing.end());
+        requests.swap(missing);
+    }
+    wake.notify_one();
+}
+
+// Routine run by the worker thread: generates the requested chunks, nearest first,
+// until the world is destroyed.
+inline void ChunkedWorld::work()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    for (;;)
+    {
+        wake.wait(lock, [&]() { return stopping || !requests.empty(); });
+        if (stopping)
+            return;
+        busy = requests.back();
+        requests.pop_back();
+        working = 1;
+        lock.unlock();
+
+        std::unique_ptr<Chunk> chunk = generateChunk(busy.first, busy.second);
+
+        lock.lock();
+        ready.push_back(std::move(chunk));
+        working = 0;
+    }
+}
+
+// Function returning the time of impact in [0, 1] at which the car body first
+// touches a cube as the car moves from pose from to pose to, or NO_IMPACT if the
+// whole motion is clear. Every cube lies inside its chunk, so only the chunks
+// under the swept path are asked.
+inline float ChunkedWorld::sweptCubeCarCollision(const CarPose& from, const CarPose& to) const
+{
+    float first = NO_IMPACT;
+
+    visitChunks(fmin(from.x, to.x) - CAR_RADIUS, fmin(from.z, to.z) - CAR_RADIUS,
+        fmax(from.x, to.x) + CAR_RADIUS, fmax(from.z, to.z) + CAR_RADIUS, [&](const Chunk& chunk)
+        {
+            first = fmin(first, chunk.field.sweptCubeCarCollision(from, to));
+        });
+    return first;
+}
+
+// Function to call visit(chunk) for each chunk in place that overlaps the
+// rectangle [minX, maxX] x [minZ, maxZ].
+template <typename Visit>
+void ChunkedWorld::visitChunks(float minX, float minZ, float maxX, float maxZ, Visit visit) const
+{
+    for (const std::unique_ptr<Chunk>& chunk : resident)
+    {
+        float x = chunk->chunkX * chunkSize, z = chunk->chunkZ * chunkSize;
+        if (x <= maxX && x + chunkSize >= minX && z <= maxZ && z + chunkSize >= minZ)
+            visit(*chunk);
+    }
+}
+
+#endif
@@ -0,0 +1,905 @@
+// Collision data structures shared by the car game.
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "mapped.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define COLLISION_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(COLLISION_X86) && defined(__GNUC__)
+#define COLLISION_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define COLLISION_TARGET_AVX2
+#endif
+
+#define SIMD_WIDTH 8 // Cubes tested per step of the widest batch kernel.
+#define CUBE_FOOTPRINT_SCALE 1.41421356f // Radius of the circle around the footprint of a cube over its half edge.
+
+// Function to check if two spheres centered at (x1,y1,z1) and (x2,y2,z2) with
+// radius r1 and r2 intersect.
+inline int checkSpheresIntersection(float x1, float y1, float z1, float r1,
+    float x2, float y2, float z2, float r2)
+{
+    return ((x1 - x2) * (x1 - x2) + (y1 - y2) * (y1 - y2) + (z1 - z2) * (z1 - z2) <= (r1 + r2) * (r1 + r2));
+}
+
+// Structure-of-arrays store of cubes. Positions and radii live in separate
+// contiguous arrays so the batch kernels below can load SIMD_WIDTH cubes at a
+// time. Every array ends with SIMD_WIDTH far-away sentinel cubes, so a kernel
+// may read a full batch past the last cube. All the arrays share one
+// allocation, laid out one after the other, so a store sized with reserve()
+// for a large map takes a single block of memory, and a store read from a
+// level file uses the mapped arrays as they are.
+class CubeStore
+{
+public:
+    CubeStore();
+    void clear();
+    void reserve(int cubes);
+    int add(float x, float y, float z, float r, unsigned char colorR,
+        unsigned char colorG, unsigned char colorB);
+    void resize(int cubes);
+    void set(int k, float x, float y, float z, float r, unsigned char colorR,
+        unsigned char colorG, unsigned char colorB);
+    void permute(const int* order, int numCubes);
+    void write(BlockWriter& out) const;
+    int read(BlockReader& in);
+    int getCount() const { return count; }
+    const float* getX() const { return storage.data(); }
+    const float* getY() const { return storage.data() + stride(); }
+    const float* getZ() const { return storage.data() + 2 * stride(); }
+    const float* getR() const { return storage.data() + 3 * stride(); }
+    const unsigned char* getColor(int k) const { return (const unsigned char*)(storage.data() + 4 * stride() + k); }
+
+private:
+    size_t stride() const { return (size_t)capacity + SIMD_WIDTH; }
+    float* array(int a) { return storage.data() + a * stride(); }
+    void addSentinel(int k);
+
+    int count;
+    int capacity; // Cubes that fit before the storage has to grow.
+    MappedArray<float> storage; // x, y, z and radius arrays, then four color bytes per cube, each stride() long.
+};
+
+// CubeStore constructor.
+inline CubeStore::CubeStore()
+{
+    count = 0;
+    capacity = 0;
+    clear();
+}
+
+// Function to remove all cubes, leaving only the sentinels. Owned storage is
+// kept for the next layout; the arrays of a level file are let go of.
+inline void CubeStore::clear()
+{
+    count = 0;
+    if (storage.isMapped() || storage.empty())
+    {
+        storage.assign(5 * SIMD_WIDTH, 0.0f);
+        capacity = 0;
+    }
+    for (int k = 0; k < SIMD_WIDTH; k++)
+        addSentinel(k);
+}
+
+// Function to put a sentinel cube in slot k of the arrays.
+inline void CubeStore::addSentinel(int k)
+{
+    array(0)[k] = array(2)[k] = 1.0e30f;
+    array(1)[k] = array(3)[k] = 0.0f;
+}
+
+// Function to make room for cubes cubes without further allocation.
+inline void CubeStore::reserve(int cubes)
+{
+    if (cubes <= capacity)
+        return;
+
+    MappedArray<float> grown(5 * ((size_t)cubes + SIMD_WIDTH));
+    size_t newStride = (size_t)cubes + SIMD_WIDTH;
+    for (int a = 0; a < 5; a++)
+        std::copy(getX() + a * stride(), getX() + a * stride() + count + SIMD_WIDTH, grown.data() + a * newStride);
+    storage.swap(grown);
+    capacity = cubes;
+}
+
+// Function to append a cube and return its index. The cube takes the place of
+// the first sentinel and a fresh sentinel is appended.
+inline int CubeStore::add(float x, float y, float z, float r, unsigned char colorR,
+    unsigned char colorG, unsigned char colorB)
+{
+    if (count == capacity)
+        reserve(capacity < 64 ? 64 : 2 * capacity);
+
+    unsigned char rgba[4] = { colorR, colorG, colorB, 255 };
+    array(0)[count] = x;
+    array(1)[count] = y;
+    array(2)[count] = z;
+    array(3)[count] = r;
+    memcpy(array(4) + count, rgba, sizeof(rgba));
+    addSentinel(count + SIMD_WIDTH);
+    return count++;
+}
+
+// Function to make the store hold cubes cubes, to be given with set(). Cubes
+// beyond the old count are left undefined until then.
+inline void CubeStore::resize(int cubes)
+{
+    reserve(cubes);
+    count = cubes;
+    for (int k = 0; k < SIMD_WIDTH; k++)
+        addSentinel(count + k);
+}
+
+// Function to replace cube k, which must be below getCount(). Different cubes
+// can be set from different threads at once.
+inline void CubeStore::set(int k, float x, float y, float z, float r, unsigned char colorR,
+    unsigned char colorG, unsigned char colorB)
+{
+    unsigned char rgba[4] = { colorR, colorG, colorB, 255 };
+    array(0)[k] = x;
+    array(1)[k] = y;
+    array(2)[k] = z;
+    array(3)[k] = r;
+    memcpy(array(4) + k, rgba, sizeof(rgba));
+}
+
+// Function to reorder the cubes so that the new cube n is the old cube order[n],
+// for n below numCubes. Cubes missing from order are dropped.
+inline void CubeStore::permute(const int* order, int numCubes)
+{
+    CubeStore sorted;
+    sorted.reserve(numCubes);
+    for (int n = 0; n < numCubes; n++)
+    {
+        int k = order[n];
+        const unsigned char* rgb = getColor(k);
+        sorted.add(getX()[k], getY()[k], getZ()[k], getR()[k], rgb[0], rgb[1], rgb[2]);
+    }
+    *this = std::move(sorted);
+}
+
+// Function to write the cubes to out as one block, without the spare capacity.
+inline void CubeStore::write(BlockWriter& out) const
+{
+    out.value(count);
+    out.begin<float>(5 * ((size_t)count + SIMD_WIDTH));
+    for (int a = 0; a < 5; a++)
+        out.append(getX() + a * stride(), (size_t)count + SIMD_WIDTH);
+}
+
+// Function to read cubes written by write() from in. Returns 1 on success and 0
+// if the block does not hold a store of cubes.
+inline int CubeStore::read(BlockReader& in)
+{
+    MappedArray<float> arrays;
+    int cubes;
+
+    if (!in.value(cubes) || !in.array(arrays) || cubes < 0 || arrays.size() != 5 * ((size_t)cubes + SIMD_WIDTH))
+        return 0;
+    storage.swap(arrays);
+    count = capacity = cubes;
+    return 1;
+}
+
+// Scalar batch kernel: index of the first cube in [begin, end) that intersects
+// the sphere of radius r centered at (x, y, z), or -1. Each cube counts as a
+// sphere of scale times its half edge: 1 for the sphere inside it, and
+// CUBE_FOOTPRINT_SCALE for the circle around its footprint on the ground plane.
+inline int findSphereOverlapScalar(const CubeStore& store, int begin, int end,
+    float x, float y, float z, float r, float scale)
+{
+    const float* cx = store.getX(), * cy = store.getY(), * cz = store.getZ(), * cr = store.getR();
+    for (int k = begin; k < end; k++)
+        if (checkSpheresIntersection(x, y, z, r, cx[k], cy[k], cz[k], scale * cr[k]))
+            return k;
+    return -1;
+}
+
+// Function returning the index of the lowest set bit of a nonzero mask.
+inline int lowestBit(int mask)
+{
+    int bit = 0;
+    while (!(mask & 1))
+    {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+}
+
+#ifdef COLLISION_X86
+// SSE batch kernel: tests 4 cubes per instruction.
+inline int findSphereOverlapSSE(const CubeStore& store, int begin, int end,
+    float x, float y, float z, float r, float scale)
+{
+    const float* cx = store.getX(), * cy = store.getY(), * cz = store.getZ(), * cr = store.getR();
+    __m128 px = _mm_set1_ps(x), py = _mm_set1_ps(y), pz = _mm_set1_ps(z), pr = _mm_set1_ps(r);
+    __m128 ps = _mm_set1_ps(scale);
+    for (int k = begin; k < end; k += 4)
+    {
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(cx + k), px);
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(cy + k), py);
+        __m128 dz = _mm_sub_ps(_mm_loadu_ps(cz + k), pz);
+        __m128 rs = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(cr + k), ps), pr);
+        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        int mask = _mm_movemask_ps(_mm_cmple_ps(d2, _mm_mul_ps(rs, rs)));
+        if (end - k < 4)
+            mask &= (1 << (end - k)) - 1; // Ignore lanes past the range.
+        if (mask)
+            return k + lowestBit(mask);
+    }
+    return -1;
+}
+
+// AVX2 batch kernel: tests 8 cubes per instruction.
+COLLISION_TARGET_AVX2
+inline int findSphereOverlapAVX2(const CubeStore& store, int begin, int end,
+    float x, float y, float z, float r, float scale)
+{
+    const float* cx = store.getX(), * cy = store.getY(), * cz = store.getZ(), * cr = store.getR();
+    __m256 px = _mm256_set1_ps(x), py = _mm256_set1_ps(y), pz = _mm256_set1_ps(z), pr = _mm256_set1_ps(r);
+    __m256 ps = _mm256_set1_ps(scale);
+    for (int k = begin; k < end; k += 8)
+    {
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(cx + k), px);
+        __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(cy + k), py);
+        __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(cz + k), pz);
+        __m256 rs = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(cr + k), ps), pr);
+        __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+            _mm256_mul_ps(dz, dz));
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_mul_ps(rs, rs), _CMP_LE_OQ));
+        if (end - k < 8)
+            mask &= (1 << (end - k)) - 1; // Ignore lanes past the range.
+        if (mask)
+            return k + lowestBit(mask);
+    }
+    return -1;
+}
+
+// Function to check whether both the CPU and the OS support AVX2.
+inline int cpuHasAVX2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return 0;
+    __cpuid(info, 1);
+    if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6) // OSXSAVE set and YMM state enabled.
+        return 0;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+typedef int (*SphereKernel)(const CubeStore& store, int begin, int end,
+    float x, float y, float z, float r, float scale);
+
+// Function to pick the widest batch kernel the running CPU supports. If name is
+// given it is set to a short name of the chosen kernel.
+inline SphereKernel selectSphereKernel(const char** name = 0)
+{
+    const char* chosen = "scalar";
+    SphereKernel kernel = findSphereOverlapScalar;
+#ifdef COLLISION_X86
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    chosen = "sse2";
+    kernel = findSphereOverlapSSE;
+#endif
+    if (cpuHasAVX2())
+    {
+        chosen = "avx2";
+        kernel = findSphereOverlapAVX2;
+    }
+#endif
+    if (name)
+        *name = chosen;
+    return kernel;
+}
+
+// Function returning the index of the first cube in [begin, end) of store that
+// intersects the sphere of radius r centered at (x, y, z), or -1, with the cubes
+// counted as spheres of scale times their half edge. Dispatches to the kernel
+// chosen for this CPU on first use.
+inline int findSphereOverlap(const CubeStore& store, int begin, int end,
+    float x, float y, float z, float r, float scale = 1.0f)
+{
+    static const SphereKernel kernel = selectSphereKernel();
+    return kernel(store, begin, end, x, y, z, r, scale);
+}
+
+// Scalar pose kernel: bitmask of which of the SIMD_WIDTH spheres of radius r
+// centered at (px[l], 0, pz[l]) intersect the cube centered at (x, y, z) with
+// radius cr. This is the transpose of findSphereOverlap(): many query spheres
+// against one cube.
+inline int findPosesOverlapScalar(const float* px, const float* pz, float r,
+    float x, float y, float z, float cr)
+{
+    int mask = 0;
+    for (int l = 0; l < SIMD_WIDTH; l++)
+        if (checkSpheresIntersection(px[l], 0.0f, pz[l], r, x, y, z, cr))
+            mask |= 1 << l;
+    return mask;
+}
+
+#ifdef COLLISION_X86
+// SSE pose kernel: tests 4 query spheres per instruction.
+inline int findPosesOverlapSSE(const float* px, const float* pz, float r,
+    float x, float y, float z, float cr)
+{
+    __m128 cx = _mm_set1_ps(x), cz = _mm_set1_ps(z), rs = _mm_set1_ps((r + cr) * (r + cr));
+    __m128 dy2 = _mm_set1_ps(y * y);
+    int mask = 0;
+    for (int l = 0; l < SIMD_WIDTH; l += 4)
+    {
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(px + l), cx);
+        __m128 dz = _mm_sub_ps(_mm_loadu_ps(pz + l), cz);
+        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), dy2), _mm_mul_ps(dz, dz));
+        mask |= _mm_movemask_ps(_mm_cmple_ps(d2, rs)) << l;
+    }
+    return mask;
+}
+
+// AVX2 pose kernel: tests 8 query spheres per instruction.
+COLLISION_TARGET_AVX2
+inline int findPosesOverlapAVX2(const float* px, const float* pz, float r,
+    float x, float y, float z, float cr)
+{
+    __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(px), _mm256_set1_ps(x));
+    __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(pz), _mm256_set1_ps(z));
+    __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_set1_ps(y * y)),
+        _mm256_mul_ps(dz, dz));
+    return _mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_set1_ps((r + cr) * (r + cr)), _CMP_LE_OQ));
+}
+#endif
+
+typedef int (*PoseKernel)(const float* px, const float* pz, float r,
+    float x, float y, float z, float cr);
+
+// Function to pick the pose kernel matching selectSphereKernel().
+inline PoseKernel selectPoseKernel()
+{
+    SphereKernel kernel = selectSphereKernel();
+#ifdef COLLISION_X86
+    if (kernel == findSphereOverlapAVX2)
+        return findPosesOverlapAVX2;
+    if (kernel == findSphereOverlapSSE)
+        return findPosesOverlapSSE;
+#endif
+    return findPosesOverlapScalar;
+}
+
+// Function returning the bitmask of which of SIMD_WIDTH query spheres intersect
+// one cube. Dispatches to the kernel chosen for this CPU on first use.
+inline int findPosesOverlap(const float* px, const float* pz, float r,
+    float x, float y, float z, float cr)
+{
+    static const PoseKernel kernel = selectPoseKernel();
+    return kernel(px, pz, r, x, y, z, cr);
+}
+
+#define NO_IMPACT 2.0f // Time of impact reported when a sweep hits nothing.
+
+// Function returning the time t in [0, 1] at which a sphere of radius r1 moving
+// in a straight line from (x0,y0,z0) to (x1,y1,z1) first touches the sphere of
+// radius r2 centered at (x2,y2,z2), or NO_IMPACT if it does not. This is the
+// capsule swept by the moving sphere tested against the static one.
+inline float sweptSphereTimeOfImpact(float x0, float y0, float z0, float x1, float y1, float z1,
+    float r1, float x2, float y2, float z2, float r2)
+{
+    float dx = x1 - x0, dy = y1 - y0, dz = z1 - z0; // Motion.
+    float mx = x0 - x2, my = y0 - y2, mz = z0 - z2; // Start offset from the static sphere.
+    float c = mx * mx + my * my + mz * mz - (r1 + r2) * (r1 + r2);
+
+    if (c <= 0)
+        return 0.0f; // Already touching at the start.
+    float b = mx * dx + my * dy + mz * dz;
+    if (b >= 0)
+        return NO_IMPACT; // Not moving towards the static sphere.
+    float a = dx * dx + dy * dy + dz * dz;
+    float discriminant = b * b - a * c;
+    if (discriminant < 0)
+        return NO_IMPACT; // The line of motion misses it.
+    float t = (-b - std::sqrt(discriminant)) / a;
+    return t <= 1.0f ? t : NO_IMPACT;
+}
+
+// Function returning the earliest time of impact of a sphere of radius r moving
+// from (x0,y0,z0) to (x1,y1,z1) against the cubes in [begin, end) of store, or
+// NO_IMPACT. If hit is given it is set to the index of the cube hit first.
+inline float findSweptSphereImpact(const CubeStore& store, int begin, int end,
+    float x0, float y0, float z0, float x1, float y1, float z1, float r, int* hit = 0)
+{
+    const float* cx = store.getX(), * cy = store.getY(), * cz = store.getZ(), * cr = store.getR();
+    float first = NO_IMPACT, t;
+    for (int k = begin; k < end; k++)
+        if ((t = sweptSphereTimeOfImpact(x0, y0, z0, x1, y1, z1, r, cx[k], cy[k], cz[k], cr[k])) < first)
+        {
+            first = t;
+            if (hit)
+                *hit = k;
+        }
+    return first;
+}
+
+// Function to check if a box on the ground plane centered at (x1, z1) intersects
+// the axis-aligned cube centered at (x2, z2) with half edge h2. The box has half
+// extent halfWidth along its local x axis (cosA, -sinA) and halfLength along its
+// local z axis (sinA, cosA), i.e. it is rotated by angle A about the y axis.
+// Uses the separating axis test on the four edge normals. The boxes are assumed
+// to overlap in y, as the car body always does with a cube.
+inline int checkBoxCubeIntersection(float x1, float z1, float cosA, float sinA,
+    float halfWidth, float halfLength, float x2, float z2, float h2)
+{
+    float dx = x2 - x1, dz = z2 - z1;
+    float ac = std::fabs(cosA), as = std::fabs(sinA);
+
+    if (std::fabs(dx) > h2 + halfWidth * ac + halfLength * as) return 0; // World x axis.
+    if (std::fabs(dz) > h2 + halfWidth * as + halfLength * ac) return 0; // World z axis.
+    if (std::fabs(dx * cosA - dz * sinA) > halfWidth + h2 * (ac + as)) return 0; // Box x axis.
+    if (std::fabs(dx * sinA + dz * cosA) > halfLength + h2 * (ac + as)) return 0; // Box z axis.
+    return 1;
+}
+
+// Function returning the time t in [0, 1] at which the box of checkBoxCubeIntersection()
+// moving without rotation from (x0, z0) to (x1, z1) first touches the cube centered
+// at (x2, z2) with half edge h2, or NO_IMPACT if it does not. Each separating axis
+// gives the interval of t during which the projections overlap, and the shapes
+// touch at the start of the intersection of those intervals.
+inline float sweptBoxCubeTimeOfImpact(float x0, float z0, float x1, float z1, float cosA, float sinA,
+    float halfWidth, float halfLength, float x2, float z2, float h2)
+{
+    float ac = std::fabs(cosA), as = std::fabs(sinA);
+    float axisX[4] = { 1.0f, 0.0f, cosA, sinA };
+    float axisZ[4] = { 0.0f, 1.0f, -sinA, cosA };
+    float extent[4] = { h2 + halfWidth * ac + halfLength * as, h2 + halfWidth * as + halfLength * ac,
+        halfWidth + h2 * (ac + as), halfLength + h2 * (ac + as) };
+    float enter = 0.0f, exit = 1.0f;
+
+    for (int n = 0; n < 4; n++)
+    {
+        float offset = (x2 - x0) * axisX[n] + (z2 - z0) * axisZ[n]; // Separation at t = 0.
+        float speed = (x1 - x0) * axisX[n] + (z1 - z0) * axisZ[n]; // Closing speed.
+        if (speed == 0.0f)
+        {
+            if (std::fabs(offset) > extent[n])
+                return NO_IMPACT; // Separated for the whole motion.
+            continue;
+        }
+        float t0 = (offset - extent[n]) / speed, t1 = (offset + extent[n]) / speed;
+        if (t0 > t1)
+        {
+            float t = t0;
+            t0 = t1;
+            t1 = t;
+        }
+        if (t0 > enter) enter = t0;
+        if (t1 < exit) exit = t1;
+        if (enter > exit)
+            return NO_IMPACT;
+    }
+    return enter;
+}
+
+// Function returning the index of the first cube in [begin, end) of store that
+// intersects the box of checkBoxCubeIntersection() centered at (x, z), or -1.
+// The batch sphere kernel with the box's bounding circle against the circle
+// around each cube's footprint rejects most cubes, and only the remaining ones
+// get the exact box test. The circle inside a cube would miss its corners.
+inline int findBoxOverlap(const CubeStore& store, int begin, int end, float x, float z,
+    float cosA, float sinA, float halfWidth, float halfLength)
+{
+    float boundingRadius = std::sqrt(halfWidth * halfWidth + halfLength * halfLength);
+    int k = begin - 1;
+
+    while ((k = findSphereOverlap(store, k + 1, end, x, 0.0f, z, boundingRadius, CUBE_FOOTPRINT_SCALE)) >= 0)
+        if (checkBoxCubeIntersection(x, z, cosA, sinA, halfWidth, halfLength,
+            store.getX()[k], store.getZ()[k], store.getR()[k]))
+            return k;
+    return -1;
+}
+
+// Function returning the earliest time of impact of the box of checkBoxCubeIntersection()
+// moving from (x0, z0) to (x1, z1) against the cubes in [begin, end) of store, or
+// NO_IMPACT. The swept bounding circle against the circle around each cube's
+// footprint rejects most cubes before the exact sweep.
+inline float findSweptBoxImpact(const CubeStore& store, int begin, int end, float x0, float z0,
+    float x1, float z1, float cosA, float sinA, float halfWidth, float halfLength, int* hit = 0)
+{
+    const float* cx = store.getX(), * cy = store.getY(), * cz = store.getZ(), * cr = store.getR();
+    float boundingRadius = std::sqrt(halfWidth * halfWidth + halfLength * halfLength);
+    float first = NO_IMPACT, t;
+
+    for (int k = begin; k < end; k++)
+        if (sweptSphereTimeOfImpact(x0, 0.0f, z0, x1, 0.0f, z1, boundingRadius, cx[k], cy[k], cz[k],
+            CUBE_FOOTPRINT_SCALE * cr[k]) <= 1.0f)
+            if ((t = sweptBoxCubeTimeOfImpact(x0, z0, x1, z1, cosA, sinA, halfWidth, halfLength,
+                cx[k], cz[k], cr[k])) < first)
+            {
+                first = t;
+                if (hit)
+                    *hit = k;
+            }
+    return first;
+}
+
+// Function returning the distance along the ray from (x, z) in the unit direction
+// (dirX, dirZ) at which it enters the cube centered at (cx, cz) with half edge h,
+// or a negative value if it misses. Returns 0 if the ray starts inside the cube.
+inline float rayCubeDistance(float x, float z, float dirX, float dirZ, float cx, float cz, float h)
+{
+    float enter = 0.0f, exit = 1.0e30f;
+    float origin[2] = { x - cx, z - cz }, dir[2] = { dirX, dirZ };
+
+    for (int n = 0; n < 2; n++)
+    {
+        if (dir[n] == 0.0f)
+        {
+            if (std::fabs(origin[n]) > h)
+                return -1.0f; // Parallel to and outside this slab.
+            continue;
+        }
+        float t0 = (-h - origin[n]) / dir[n], t1 = (h - origin[n]) / dir[n];
+        if (t0 > t1)
+        {
+            float t = t0;
+            t0 = t1;
+            t1 = t;
+        }
+        if (t0 > enter) enter = t0;
+        if (t1 < exit) exit = t1;
+        if (enter > exit)
+            return -1.0f;
+    }
+    return enter;
+}
+
+// Function returning the distance along a ray to the nearest cube in [begin, end)
+// of store if it is closer than limit, and limit otherwise. If hit is given it is
+// set to the index of that cube.
+inline float findRayImpact(const CubeStore& store, int begin, int end, float x, float z,
+    float dirX, float dirZ, float limit, int* hit = 0)
+{
+    const float* cx = store.getX(), * cz = store.getZ(), * cr = store.getR();
+    float t;
+
+    for (int k = begin; k < end; k++)
+        if ((t = rayCubeDistance(x, z, dirX, dirZ, cx[k], cz[k], cr[k])) >= 0 && t < limit)
+        {
+            limit = t;
+            if (hit)
+                *hit = k;
+        }
+    return limit;
+}
+
+// Uniform grid over the ground (x-z) plane used as the collision broad-phase.
+// Each object is binned by its center into exactly one cell and the contents of
+// a cell are stored contiguously, so a query only visits the cells under the
+// query sphere however many objects there are.
+class UniformGrid
+{
+public:
+    UniformGrid();
+    void build(const float* x, const float* z, const float* r, int count, float size);
+    template <typename Visit>
+    int query(float x, float z, float r, Visit visit) const;
+    template <typename Visit>
+    int queryBox(float minX, float minZ, float maxX, float maxZ, Visit visit) const;
+    template <typename Visit>
+    int queryRanges(float minX, float minZ, float maxX, float maxZ, Visit visit) const;
+    const MappedArray<int>& getItems() const { return cellItems; }
+    static double countCells(const float* x, const float* z, const float* r, int count, float size);
+    int getCellsX() const { return cellsX; }
+    int getCellsZ() const { return cellsZ; }
+    void write(BlockWriter& out) const;
+    int read(BlockReader& in, int objects);
+
+private:
+    int cellRange(float minX, float minZ, float maxX, float maxZ,
+        int* x0, int* z0, int* x1, int* z1) const;
+
+    float originX, originZ, cellSize, invCellSize, maxRadius;
+    int cellsX, cellsZ;
+    MappedArray<int> cellStart; // Cell c holds cellItems[cellStart[c]] .. cellItems[cellStart[c + 1] - 1].
+    MappedArray<int> cellItems; // Object indices grouped by cell.
+};
+
+// UniformGrid default constructor.
+inline UniformGrid::UniformGrid()
+{
+    originX = 0.0;
+    originZ = 0.0;
+    cellSize = 1.0;
+    invCellSize = 1.0;
+    maxRadius = 0.0;
+    cellsX = 0; // Indicates an empty grid.
+    cellsZ = 0;
+}
+
+// Function to bin count objects centered at (x[k], z[k]) with radius r[k] into
+// cells of edge length size. Objects with radius 0 do not exist and are skipped.
+inline void UniformGrid::build(const float* x, const float* z, const float* r, int count, float size)
+{
+    int k, c;
+    float minX = 0.0, minZ = 0.0, maxX = 0.0, maxZ = 0.0;
+    int first = 1;
+
+    cellSize = size;
+    invCellSize = 1.0f / size;
+    maxRadius = 0.0;
+    for (k = 0; k < count; k++)
+        if (r[k] > 0)
+        {
+            if (first || x[k] < minX) minX = x[k];
+            if (first || x[k] > maxX) maxX = x[k];
+            if (first || z[k] < minZ) minZ = z[k];
+            if (first || z[k] > maxZ) maxZ = z[k];
+            if (r[k] > maxRadius) maxRadius = r[k];
+            first = 0;
+        }
+
+    cellStart.clear();
+    cellItems.clear();
+    if (first) // No objects at all.
+    {
+        cellsX = cellsZ = 0;
+        return;
+    }
+
+    originX = minX;
+    originZ = minZ;
+    cellsX = (int)((maxX - minX) * invCellSize) + 1;
+    cellsZ = (int)((maxZ - minZ) * invCellSize) + 1;
+
+    // Counting sort of the objects by cell.
+    cellStart.assign(cellsX * cellsZ + 1, 0);
+    for (k = 0; k < count; k++)
+        if (r[k] > 0)
+        {
+            c = (int)((z[k] - originZ) * invCellSize) * cellsX + (int)((x[k] - originX) * invCellSize);
+            cellStart[c + 1]++;
+        }
+    for (c = 0; c < cellsX * cellsZ; c++)
+        cellStart[c + 1] += cellStart[c];
+
+    std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+    cellItems.resize(cellStart[cellsX * cellsZ]);
+    for (k = 0; k < count; k++)
+        if (r[k] > 0)
+        {
+            c = (int)((z[k] - originZ) * invCellSize) * cellsX + (int)((x[k] - originX) * invCellSize);
+            cellItems[fill[c]++] = k;
+        }
+}
+
+// Function to write the grid to out.
+inline void UniformGrid::write(BlockWriter& out) const
+{
+    float params[5] = { originX, originZ, cellSize, invCellSize, maxRadius };
+    int cells[2] = { cellsX, cellsZ };
+
+    out.array(params, 5);
+    out.array(cells, 2);
+    out.array(cellStart.data(), cellStart.size());
+    out.array(cellItems.data(), cellItems.size());
+}
+
+// Function to read a grid written by write() over objects objects from in.
+// Returns 1 on success and 0 if the blocks do not hold such a grid. The cells
+// must be in order, so that every run queryRanges() reports lies within the
+// objects; when verifying, the items must also be in range.
+inline int UniformGrid::read(BlockReader& in, int objects)
+{
+    MappedArray<float> paramsRead;
+    MappedArray<int> cellsRead, start, items;
+
+    if (!in.array(paramsRead) || !in.array(cellsRead) || !in.array(start) || !in.array(items))
+        return 0;
+    const float* params = paramsRead.begin();
+    const int* cells = cellsRead.begin(), * first = start.begin(), * item = items.begin();
+    if (paramsRead.size() != 5 || cellsRead.size() != 2 || cells[0] < 0 || cells[1] < 0 ||
+        items.size() > (size_t)objects)
+        return 0;
+    for (int n = 0; n < 5; n++)
+        if (!std::isfinite(params[n]))
+            return 0;
+    size_t numCells = (size_t)cells[0] * cells[1];
+    if (numCells == 0 ? !start.empty() || !items.empty() :
+        start.size() != numCells + 1 || first[0] != 0 || first[numCells] != (int)items.size())
+        return 0;
+    for (size_t c = 0; c < numCells; c++)
+        if (first[c] > first[c + 1])
+            return 0;
+    if (in.isVerifying())
+        for (size_t k = 0; k < items.size(); k++)
+            if (item[k] < 0 || item[k] >= objects)
+                return 0;
+
+    originX = params[0];
+    originZ = params[1];
+    cellSize = params[2];
+    invCellSize = params[3];
+    maxRadius = params[4];
+    cellsX = cells[0];
+    cellsZ = cells[1];
+    cellStart = std::move(start);
+    cellItems = std::move(items);
+    return 1;
+}
+
+// Function returning the number of cells build() would allocate for the same
+// objects, without allocating them.
+inline double UniformGrid::countCells(const float* x, const float* z, const float* r, int count, float size)
+{
+    float minX = 0.0, minZ = 0.0, maxX = 0.0, maxZ = 0.0;
+    int first = 1;
+
+    for (int k = 0; k < count; k++)
+        if (r[k] > 0)
+        {
+            if (first || x[k] < minX) minX = x[k];
+            if (first || x[k] > maxX) maxX = x[k];
+            if (first || z[k] < minZ) minZ = z[k];
+            if (first || z[k] > maxZ) maxZ = z[k];
+            first = 0;
+        }
+    if (first)
+        return 0.0;
+    return (std::floor((maxX - minX) / size) + 1) * (std::floor((maxZ - minZ) / size) + 1);
+}
+
+// Function to find the cells [x0, x1] x [z0, z1] that may hold objects overlapping
+// the rectangle [minX, maxX] x [minZ, maxZ]. Returns 0 if there are none.
+inline int UniformGrid::cellRange(float minX, float minZ, float maxX, float maxZ,
+    int* x0, int* z0, int* x1, int* z1) const
+{
+    if (cellsX == 0)
+        return 0;
+
+    // Objects are binned by center only, so widen the rectangle by the largest radius.
+    float fx0 = std::floor((minX - maxRadius - originX) * invCellSize);
+    float fx1 = std::floor((maxX + maxRadius - originX) * invCellSize);
+    float fz0 = std::floor((minZ - maxRadius - originZ) * invCellSize);
+    float fz1 = std::floor((maxZ + maxRadius - originZ) * invCellSize);
+    if (fx1 < 0 || fz1 < 0 || fx0 >= cellsX || fz0 >= cellsZ)
+        return 0;
+    *x0 = fx0 < 0 ? 0 : (int)fx0;
+    *z0 = fz0 < 0 ? 0 : (int)fz0;
+    *x1 = fx1 >= cellsX ? cellsX - 1 : (int)fx1;
+    *z1 = fz1 >= cellsZ ? cellsZ - 1 : (int)fz1;
+    return 1;
+}
+
+// Function to call visit(k) for every object that may overlap the sphere of
+// radius r centered at (x, z). Stops at and returns the first nonzero result.
+template <typename Visit>
+int UniformGrid::query(float x, float z, float r, Visit visit) const
+{
+    return queryBox(x - r, z - r, x + r, z + r, visit);
+}
+
+// Function to call visit(k) for every object that may overlap the rectangle
+// [minX, maxX] x [minZ, maxZ]. Stops at and returns the first nonzero result.
+template <typename Visit>
+int UniformGrid::queryBox(float minX, float minZ, float maxX, float maxZ, Visit visit) const
+{
+    int i, j, k, x0, z0, x1, z1, result;
+
+    if (!cellRange(minX, minZ, maxX, maxZ, &x0, &z0, &x1, &z1))
+        return 0;
+    for (j = z0; j <= z1; j++)
+        for (i = x0; i <= x1; i++)
+            for (k = cellStart[j * cellsX + i]; k < cellStart[j * cellsX + i + 1]; k++)
+                if ((result = visit(cellItems[k])) != 0)
+                    return result;
+    return 0;
+}
+
+// Function to call visit(begin, end) with runs of consecutive object indices
+// covering every object that may overlap the rectangle [minX, maxX] x [minZ, maxZ].
+// Only valid when the objects are stored in cell order (see buildCubeGrid()),
+// in which case the cells of one grid row under the rectangle form one run.
+template <typename Visit>
+int UniformGrid::queryRanges(float minX, float minZ, float maxX, float maxZ, Visit visit) const
+{
+    int j, begin, end, x0, z0, x1, z1, result;
+
+    if (!cellRange(minX, minZ, maxX, maxZ, &x0, &z0, &x1, &z1))
+        return 0;
+    for (j = z0; j <= z1; j++)
+    {
+        begin = cellStart[j * cellsX + x0];
+        end = cellStart[j * cellsX + x1 + 1];
+        if (begin < end && (result = visit(begin, end)) != 0)
+            return result;
+    }
+    return 0;
+}
+
+// Cache of the runs of cubes found by a broad-phase query around the last query
+// position. Consecutive queries from a moving car mostly fall inside the cached
+// region and then only the cached runs are tested, without walking the
+// broad-phase. The cache is refilled when a query leaves the region.
+class RunCache
+{
+public:
+    RunCache() { valid = 0; }
+    void invalidate() { valid = 0; }
+    int covers(float minX, float minZ, float maxX, float maxZ) const;
+    template <typename Query>
+    void refill(float minX, float minZ, float maxX, float maxZ, Query query);
+    template <typename Visit>
+    int visitRuns(Visit visit) const;
+
+private:
+    int valid; // Is the cached region current?
+    float regionMinX, regionMinZ, regionMaxX, regionMaxZ;
+    std::vector<int> runs; // Begin and end of each cached run.
+};
+
+// Function to check if the rectangle [minX, maxX] x [minZ, maxZ] lies within the
+// cached region, so that the cached runs hold every cube it may overlap.
+inline int RunCache::covers(float minX, float minZ, float maxX, float maxZ) const
+{
+    return valid && minX >= regionMinX && minZ >= regionMinZ && maxX <= regionMaxX && maxZ <= regionMaxZ;
+}
+
+// Function to cache the runs that query(minX, minZ, maxX, maxZ, visit) reports
+// for the rectangle [minX, maxX] x [minZ, maxZ].
+template <typename Query>
+void RunCache::refill(float minX, float minZ, float maxX, float maxZ, Query query)
+{
+    runs.clear();
+    query(minX, minZ, maxX, maxZ, [&](int begin, int end)
+        {
+            runs.push_back(begin);
+            runs.push_back(end);
+            return 0;
+        });
+    regionMinX = minX;
+    regionMinZ = minZ;
+    regionMaxX = maxX;
+    regionMaxZ = maxZ;
+    valid = 1;
+}
+
+// Function to call visit(begin, end) for each cached run. Stops at and returns
+// the first nonzero result.
+template <typename Visit>
+int RunCache::visitRuns(Visit visit) const
+{
+    int result;
+    for (size_t n = 0; n < runs.size(); n += 2)
+        if ((result = visit(runs[n], runs[n + 1])) != 0)
+            return result;
+    return 0;
+}
+
+// Function to sort the cubes of store into cell order and build grid over them,
+// so that grid.queryRanges() yields runs of consecutive cubes in the store.
+inline void buildCubeGrid(CubeStore& store, UniformGrid& grid, float cellSize)
+{
+    grid.build(store.getX(), store.getZ(), store.getR(), store.getCount(), cellSize);
+    store.permute(grid.getItems().data(), (int)grid.getItems().size());
+    grid.build(store.getX(), store.getZ(), store.getR(), store.getCount(), cellSize);
+}
+
+#endif
@@ -0,0 +1,179 @@
+// Collision micro-benchmark. Runs headless, no window is opened.
+//
+// Build: g++ -O2 -std=c++17 collision_bench.cpp -o collision_bench -lpthread
+// Usage: collision_bench [--queries N] [--seed S] [--sdf] [--sizes 8x6,100x100] [--fills 25,100]
+//
+// For every grid size and fill probability it generates a layout, then times
+// cubeCarCollision() on random car poses over the layout, the batched pose query
+// and raw checkSpheresIntersection() calls. It also times both queries on a
+// planner's workload: PLANNER_CANDIDATES poses within PLANNER_SPREAD of each of
+// a series of random car positions, checked one batch per car position. Results
+// are printed as JSON.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "obstacles.h"
+
+#define PLANNER_CANDIDATES 64 // Candidate poses around each car position of the planner workload.
+#define PLANNER_SPREAD 5.0f // Farthest a candidate lies from its car position along each axis.
+
+// Function returning the seconds elapsed since start.
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Function to parse a comma separated list of integers, or of RxC pairs if pairs is set.
+static std::vector<int> parseList(const char* text, int pairs)
+{
+    std::vector<int> values;
+    for (const char* c = text; *c != '\0';)
+    {
+        char* end;
+        values.push_back((int)strtol(c, &end, 10));
+        if (pairs && *end == 'x')
+            values.push_back((int)strtol(end + 1, &end, 10));
+        c = *end == ',' ? end + 1 : end;
+        if (end == c && *c != '\0')
+            break; // Malformed list.
+    }
+    return values;
+}
+
+// Main routine.
+int main(int argc, char** argv)
+{
+    int queries = 200000, seed = 1, sdf = 0;
+    std::vector<int> sizes = { 8, 6, 32, 32, 100, 100, 316, 316, 1000, 1000 };
+    std::vector<int> fills = { 25, 50, 100 };
+
+    for (int n = 1; n < argc; n++)
+        if (!strcmp(argv[n], "--queries") && n + 1 < argc)
+            queries = atoi(argv[++n]);
+        else if (!strcmp(argv[n], "--seed") && n + 1 < argc)
+            seed = atoi(argv[++n]);
+        else if (!strcmp(argv[n], "--sdf"))
+            sdf = 1;
+        else if (!strcmp(argv[n], "--sizes") && n + 1 < argc)
+            sizes = parseList(argv[++n], 1);
+        else if (!strcmp(argv[n], "--fills") && n + 1 < argc)
+            fills = parseList(argv[++n], 0);
+        else
+        {
+            fprintf(stderr, "Usage: %s [--queries N] [--seed S] [--sdf] [--sizes RxC,...] [--fills P,...]\n", argv[0]);
+            return 1;
+        }
+
+    const char* kernelName;
+    selectSphereKernel(&kernelName);
+    printf("{\n  \"kernel\": \"%s\",\n  \"queries\": %d,\n  \"seed\": %d,\n  \"sdf\": %s,\n  \"results\": [",
+        kernelName, queries, seed, sdf ? "true" : "false");
+
+    std::mt19937 random(seed);
+    std::vector<float> x(queries), z(queries), a(queries);
+    std::vector<CarPose> candidates(queries);
+    std::vector<unsigned char> hits(queries);
+    const char* separator = "\n";
+
+    for (size_t s = 0; s + 1 < sizes.size(); s += 2)
+        for (int fill : fills)
+        {
+            int rows = sizes[s], columns = sizes[s + 1], n;
+            ObstacleField field;
+            field.bakeDistanceField = sdf;
+
+            Pcg32 layoutRandom(seed, 0);
+            auto start = std::chrono::steady_clock::now();
+            field.generateLayout(makeLayoutParams(rows, columns, fill), layoutRandom);
+            field.build();
+            double buildSeconds = secondsSince(start);
+            const CubeStore& cubes = field.cubes;
+
+            // Random poses over the layout and a margin around it.
+            std::uniform_real_distribution<float> randomX(-15.0f * columns - 30.0f, 15.0f * columns + 30.0f);
+            std::uniform_real_distribution<float> randomZ(-40.0f - 30.0f * rows - 30.0f, 0.0f);
+            std::uniform_real_distribution<float> randomAngle(0.0f, 360.0f);
+            for (n = 0; n < queries; n++)
+            {
+                x[n] = randomX(random);
+                z[n] = randomZ(random);
+                a[n] = randomAngle(random);
+            }
+
+            // Candidates around car positions for the planner workload.
+            std::uniform_real_distribution<float> randomOffset(-PLANNER_SPREAD, PLANNER_SPREAD);
+            for (n = 0; n < queries; n++)
+            {
+                int car = n - n % PLANNER_CANDIDATES;
+                candidates[n] = makeCarPose(x[car] + randomOffset(random), z[car] + randomOffset(random), a[n]);
+            }
+
+            // Single pose queries.
+            int boxHits = 0;
+            start = std::chrono::steady_clock::now();
+            for (n = 0; n < queries; n++)
+                boxHits += field.cubeCarCollision(x[n], z[n], a[n]);
+            double querySeconds = secondsSince(start);
+
+            // Batched pose queries over the same poses.
+            start = std::chrono::steady_clock::now();
+            int batchHits = field.cubeCarCollisionBatch(x.data(), z.data(), a.data(), queries, hits.data());
+            double batchSeconds = secondsSince(start);
+
+            // Planner workload, one query per candidate and then one batch per car position.
+            int plannerHits = 0, plannerBatchHits = 0;
+            start = std::chrono::steady_clock::now();
+            for (n = 0; n < queries; n++)
+                plannerHits += field.cubeCarCollision(candidates[n]);
+            double plannerSeconds = secondsSince(start);
+            start = std::chrono::steady_clock::now();
+            for (n = 0; n < queries; n += PLANNER_CANDIDATES)
+                plannerBatchHits += field.cubeCarCollisionBatch(candidates.data() + n,
+                    std::min(PLANNER_CANDIDATES, queries - n), hits.data() + n);
+            double plannerBatchSeconds = secondsSince(start);
+
+            // Breakdown: how often the bounding sphere alone would report a hit.
+            int sphereHits = 0;
+            for (n = 0; n < queries; n++)
+            {
+                float px = x[n], pz = z[n];
+                sphereHits += field.queryCubes(px - CAR_RADIUS, pz - CAR_RADIUS, px + CAR_RADIUS, pz + CAR_RADIUS,
+                    [&](int begin, int end) { return findSphereOverlap(cubes, begin, end, px, 0.0f, pz, CAR_RADIUS) >= 0; });
+            }
+
+            // Raw sphere pair tests against the cubes of the layout.
+            int pairHits = 0, count = cubes.getCount();
+            start = std::chrono::steady_clock::now();
+            for (n = 0; n < queries && count > 0; n++)
+            {
+                int k = n % count;
+                pairHits += checkSpheresIntersection(x[n], 0.0f, z[n], CAR_RADIUS,
+                    cubes.getX()[k], cubes.getY()[k], cubes.getZ()[k], cubes.getR()[k]);
+            }
+            double pairSeconds = secondsSince(start);
+
+            printf("%s    {\"rows\": %d, \"columns\": %d, \"fill\": %d, \"cubes\": %d, \"broad_phase\": \"%s\", "
+                "\"build_ms\": %.3f,\n", separator, rows, columns, fill, count, field.getUseBVH() ? "bvh" : "grid",
+                buildSeconds * 1e3);
+            printf("     \"ns_per_query\": %.2f, \"queries_per_sec\": %.0f, \"batch_ns_per_pose\": %.2f, "
+                "\"batch_matches\": %s,\n", querySeconds * 1e9 / queries, queries / querySeconds,
+                batchSeconds * 1e9 / queries, batchHits == boxHits ? "true" : "false");
+            printf("     \"planner_ns_per_pose\": %.2f, \"planner_batch_ns_per_pose\": %.2f, "
+                "\"planner_batch_matches\": %s,\n", plannerSeconds * 1e9 / queries,
+                plannerBatchSeconds * 1e9 / queries, plannerBatchHits == plannerHits ? "true" : "false");
+            printf("     \"hit_rate\": %.5f, \"sphere_hit_rate\": %.5f, \"sphere_only_rate\": %.5f, "
+                "\"pair_ns_per_call\": %.3f, \"pair_hits\": %d}",
+                (double)boxHits / queries, (double)sphereHits / queries, (double)(sphereHits - boxHits) / queries,
+                pairSeconds * 1e9 / queries, pairHits);
+            separator = ",\n";
+            fflush(stdout);
+        }
+
+    printf("\n  ]\n}\n");
+    return 0;
+}
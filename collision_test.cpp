@@ -0,0 +1,196 @@
+// Collision regression test. Runs headless, no window is opened.
+//
+// Build: g++ -O2 -std=c++17 collision_test.cpp -o collision_test -lpthread
+// Usage: collision_test [--poses N] [--paths N] [--seed S]
+//
+// Checks the collision queries of ObstacleField against a brute-force
+// checkBoxCubeIntersection() over every cube. Random poses over dense and sparse
+// layouts, and over cubes of random size off the grid, half of them smaller than
+// a texel of the distance field, must give the same answer from cubeCarCollision(),
+// cubeCarCollisionBatch() and the brute force, with and without the field. Random
+// moves, turning as they go, and turns in place are sampled at PATH_SAMPLES
+// points, and sweptCubeCarCollision() must report an impact no later than the
+// first sample whose pose hits a cube. A turn in place must only report one if a
+// sample hits with the body grown by SWEPT_TURN_TOLERANCE. Where
+// the field is baked, cubeClearance() must not exceed the distance to the
+// nearest cube. Prints the mismatches found and returns 1 if there are any.
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "obstacles.h"
+
+#define PATH_SAMPLES 200 // Points each move is sampled at.
+#define PATH_LENGTH 12.0f // Longest move tested.
+#define TURN_ANGLE 10.0f // Largest turn in place tested, in degrees.
+#define TURN_SLACK 0.01f // Most the corners move between two samples of a turn.
+#define SCATTERED_CUBES 40 // Cubes of the layout off the grid.
+#define SCATTERED_EXTENT 60.0f // Half the width and depth of the area they are in.
+
+// Function to check the car in pose, its body grown by grow, against every cube of cubes.
+static int bruteForceCollision(const CubeStore& cubes, const CarPose& pose, float grow = 0.0f)
+{
+    for (int k = 0; k < cubes.getCount(); k++)
+        if (checkBoxCubeIntersection(pose.x, pose.z, -pose.headingZ, -pose.headingX, CAR_HALF_WIDTH + grow,
+            CAR_HALF_LENGTH + grow, cubes.getX()[k], cubes.getZ()[k], cubes.getR()[k]))
+            return 1;
+    return 0;
+}
+
+// Function returning the distance from (x, z) to the nearest cube of cubes.
+static float bruteForceDistance(const CubeStore& cubes, float x, float z)
+{
+    float nearest = 1.0e30f;
+    for (int k = 0; k < cubes.getCount(); k++)
+    {
+        float dx = fmaxf(fabsf(x - cubes.getX()[k]) - cubes.getR()[k], 0.0f);
+        float dz = fmaxf(fabsf(z - cubes.getZ()[k]) - cubes.getR()[k], 0.0f);
+        nearest = fminf(nearest, hypotf(dx, dz));
+    }
+    return nearest;
+}
+
+// Main routine.
+int main(int argc, char** argv)
+{
+    int poses = 200000, paths = 20000, seed = 1, failures = 0;
+
+    for (int n = 1; n < argc; n++)
+        if (!strcmp(argv[n], "--poses") && n + 1 < argc)
+            poses = atoi(argv[++n]);
+        else if (!strcmp(argv[n], "--paths") && n + 1 < argc)
+            paths = atoi(argv[++n]);
+        else if (!strcmp(argv[n], "--seed") && n + 1 < argc)
+            seed = atoi(argv[++n]);
+        else
+        {
+            fprintf(stderr, "Usage: %s [--poses N] [--paths N] [--seed S]\n", argv[0]);
+            return 1;
+        }
+
+    // Dense layouts use the grid, the widely spaced one the BVH. The last layout
+    // is of cubes scattered off the grid instead.
+    LayoutParams layouts[4] = { makeLayoutParams(8, 6, 100), makeLayoutParams(40, 40, 50),
+        makeLayoutParams(40, 40, 50, 150.0f), makeLayoutParams(0, 0, 0) };
+
+    std::mt19937 random(seed);
+    for (int l = 0; l < 4; l++)
+        for (int sdf = 0; sdf <= 1; sdf++)
+        {
+            const LayoutParams& params = layouts[l];
+            ObstacleField field;
+            std::mt19937 layoutRandom(seed);
+            field.bakeDistanceField = sdf;
+            float minX, maxX, minZ, maxZ;
+            if (l < 3)
+            {
+                Pcg32 generator(seed, 0);
+                field.generateLayout(params, generator);
+                maxX = 0.5f * params.spacing * params.columns + 30.0f;
+                minX = -maxX;
+                minZ = LAYOUT_START_Z - params.spacing * params.rows - 30.0f;
+                maxZ = 0.0f;
+            }
+            else
+            {
+                // Every other cube is smaller than a texel, the others up to eight texels wide.
+                std::uniform_real_distribution<float> randomX(-SCATTERED_EXTENT, SCATTERED_EXTENT);
+                std::uniform_real_distribution<float> randomZ(-2 * SCATTERED_EXTENT, 0.0f);
+                std::uniform_real_distribution<float> randomSmall(0.1f, 0.5f), randomLarge(0.5f, 4.0f);
+                for (int k = 0; k < SCATTERED_CUBES; k++)
+                {
+                    float x = randomX(layoutRandom), z = randomZ(layoutRandom);
+                    float r = k % 2 ? randomLarge(layoutRandom) : randomSmall(layoutRandom);
+                    field.cubes.add(x, 0.0f, z, r, 255, 255, 255);
+                }
+                minX = -SCATTERED_EXTENT - 10.0f;
+                maxX = SCATTERED_EXTENT + 10.0f;
+                minZ = -2 * SCATTERED_EXTENT - 10.0f;
+                maxZ = 10.0f;
+            }
+            field.build();
+
+            // Poses over the layout, most of them close enough to a cube to test the rejects.
+            std::uniform_real_distribution<float> randomX(minX, maxX);
+            std::uniform_real_distribution<float> randomZ(minZ, maxZ);
+            std::uniform_real_distribution<float> randomAngle(0.0f, 360.0f);
+            std::uniform_real_distribution<float> randomStep(-PATH_LENGTH, PATH_LENGTH);
+            std::vector<float> x(poses), z(poses), a(poses);
+            std::vector<unsigned char> hits(poses);
+            int n, singleMisses = 0, batchMisses = 0, clearanceMisses = 0, hitCount = 0;
+
+            for (n = 0; n < poses; n++)
+            {
+                x[n] = randomX(random);
+                z[n] = randomZ(random);
+                a[n] = randomAngle(random);
+            }
+            field.cubeCarCollisionBatch(x.data(), z.data(), a.data(), poses, hits.data());
+            for (n = 0; n < poses; n++)
+            {
+                int expected = bruteForceCollision(field.cubes, makeCarPose(x[n], z[n], a[n]));
+                hitCount += expected;
+                singleMisses += field.cubeCarCollision(x[n], z[n], a[n]) != expected;
+                batchMisses += hits[n] != expected;
+                if (sdf)
+                    clearanceMisses += field.cubeClearance(x[n], z[n]) > bruteForceDistance(field.cubes, x[n], z[n]);
+            }
+
+            // Moves from a random pose, turning evenly to a random heading.
+            int sweptMisses = 0;
+            for (n = 0; n < paths; n++)
+            {
+                float x0 = randomX(random), z0 = randomZ(random), a0 = randomAngle(random);
+                float x1 = x0 + randomStep(random), z1 = z0 + randomStep(random), a1 = randomAngle(random);
+                float impact = field.sweptCubeCarCollision(x0, z0, a0, x1, z1, a1);
+                for (int s = 0; s < PATH_SAMPLES; s++)
+                {
+                    float t = s / (float)(PATH_SAMPLES - 1);
+                    if (bruteForceCollision(field.cubes, makeCarPose(x0 + t * (x1 - x0), z0 + t * (z1 - z0),
+                        a0 + t * (a1 - a0))))
+                    {
+                        sweptMisses += impact > t + 1.0e-4f;
+                        break;
+                    }
+                }
+            }
+
+            // Turns in place, which a sweep with a single heading could swing a corner
+            // through a cube on.
+            std::uniform_real_distribution<float> randomTurn(-TURN_ANGLE, TURN_ANGLE);
+            for (n = 0; n < paths; n++)
+            {
+                float x0 = randomX(random), z0 = randomZ(random), a0 = randomAngle(random), a1 = a0 + randomTurn(random);
+                float impact = field.sweptCubeCarCollision(x0, z0, a0, x0, z0, a1);
+                // The grown body hits no later than the body itself.
+                int near = 0;
+                for (int s = 0; s < PATH_SAMPLES; s++)
+                {
+                    float t = s / (float)(PATH_SAMPLES - 1);
+                    CarPose pose = makeCarPose(x0, z0, a0 + t * (a1 - a0));
+                    near = near || bruteForceCollision(field.cubes, pose, SWEPT_TURN_TOLERANCE + TURN_SLACK);
+                    if (near && bruteForceCollision(field.cubes, pose))
+                    {
+                        sweptMisses += impact > t + 1.0e-4f;
+                        break;
+                    }
+                }
+                sweptMisses += impact <= 1.0f && !near;
+            }
+
+            if (l < 3)
+                printf("%dx%d spacing %g fill %d%%", params.rows, params.columns, params.spacing,
+                    params.fillProbability);
+            else
+                printf("%d scattered cubes", SCATTERED_CUBES);
+            printf(" %s %s: %d of %d poses hit, %d single, %d batch, %d swept and %d clearance mismatches\n",
+                field.getUseBVH() ? "bvh" : "grid", sdf ? "sdf" : "no sdf", hitCount, poses, singleMisses,
+                batchMisses, sweptMisses, clearanceMisses);
+            failures += singleMisses + batchMisses + sweptMisses + clearanceMisses;
+        }
+    printf(failures ? "FAILED\n" : "passed\n");
+    return failures != 0;
+}
@@ -0,0 +1,96 @@
+// Batch environment benchmark. Runs headless, no window is opened.
+//
+// Build: g++ -O2 -std=c++17 env_bench.cpp -o env_bench -lpthread
+// Usage: env_bench [--worlds N] [--steps S] [--seed S] [--size RxC] [--fill P] [--threads 1,2,4]
+//
+// Steps a WorldBatch of random drivers with each thread count and prints the
+// env-steps per second and the speedup over the first thread count as JSON.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "batch.h"
+
+#define INPUT_TABLES 64 // Random input arrays cycled through by the drivers.
+
+// Function to parse a comma separated list of integers.
+static std::vector<int> parseList(const char* text)
+{
+    std::vector<int> values;
+    for (const char* c = text; *c != '\0';)
+    {
+        char* end;
+        values.push_back((int)strtol(c, &end, 10));
+        if (end == c)
+            break; // Malformed list.
+        c = *end == ',' ? end + 1 : end;
+    }
+    return values;
+}
+
+// Main routine.
+int main(int argc, char** argv)
+{
+    int worlds = 4096, steps = 1000, seed = 1, rows = 8, columns = 6, fill = 100;
+    std::vector<int> threads;
+
+    for (int t = 1; t <= defaultThreadCount(); t *= 2)
+        threads.push_back(t);
+    for (int n = 1; n < argc; n++)
+        if (!strcmp(argv[n], "--worlds") && n + 1 < argc)
+            worlds = atoi(argv[++n]);
+        else if (!strcmp(argv[n], "--steps") && n + 1 < argc)
+            steps = atoi(argv[++n]);
+        else if (!strcmp(argv[n], "--seed") && n + 1 < argc)
+            seed = atoi(argv[++n]);
+        else if (!strcmp(argv[n], "--size") && n + 1 < argc && sscanf(argv[n + 1], "%dx%d", &rows, &columns) == 2)
+            n++;
+        else if (!strcmp(argv[n], "--fill") && n + 1 < argc)
+            fill = atoi(argv[++n]);
+        else if (!strcmp(argv[n], "--threads") && n + 1 < argc)
+            threads = parseList(argv[++n]);
+        else
+        {
+            fprintf(stderr, "Usage: %s [--worlds N] [--steps S] [--seed S] [--size RxC] [--fill P] [--threads T,...]\n",
+                argv[0]);
+            return 1;
+        }
+
+    // Drivers mostly go forward and turn now and then.
+    std::mt19937 random(seed);
+    std::vector<int> inputs(INPUT_TABLES * worlds), events(worlds);
+    for (int& input : inputs)
+        input = random() % 4 ? INPUT_FORWARD : (random() % 2 ? INPUT_TURN_LEFT : INPUT_TURN_RIGHT);
+
+    printf("{\n  \"worlds\": %d,\n  \"steps\": %d,\n  \"rows\": %d,\n  \"columns\": %d,\n  \"fill\": %d,\n"
+        "  \"results\": [", worlds, steps, rows, columns, fill);
+    const char* separator = "\n";
+    double baseRate = 0.0;
+    for (int t : threads)
+    {
+        WorldBatch batch(worlds, makeLayoutParams(rows, columns, fill), seed, t);
+        long long ended = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int s = 0; s < steps; s++)
+        {
+            batch.step(&inputs[(s % INPUT_TABLES) * worlds], events.data());
+            for (int w = 0; w < worlds; w++)
+                ended += (events[w] & (EVENT_LOST | EVENT_WON)) != 0;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double rate = (double)worlds * steps / seconds;
+        if (baseRate == 0.0)
+            baseRate = rate;
+
+        printf("%s    {\"threads\": %d, \"env_steps_per_sec\": %.0f, \"speedup\": %.2f, \"episodes_ended\": %lld}",
+            separator, t, rate, rate / baseRate, ended);
+        separator = ",\n";
+        fflush(stdout);
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,169 @@
+// Levels: layout parameters read from the command line or a layout file, and
+// binary level files holding a whole obstacle field ready to be mapped.
+#ifndef LEVEL_H
+#define LEVEL_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "obstacles.h"
+
+#define LEVEL_FILE_MAGIC "CLVL" // First four bytes of a level file.
+#define LEVEL_FILE_VERSION 2 // Format version written by saveLevelFile(); 1 had distance fields missing small cubes.
+#define LEVEL_BYTE_ORDER 0x01020304u // Written in native byte order to reject files from other machines.
+#define MAX_LAYOUT_SLOTS 100000000LL // Largest rows x columns accepted, ten times a 1000 x 1000 map.
+
+// Function to check that params describe a layout that can be generated.
+// Returns 1 if so and 0 otherwise.
+inline int checkLayoutParams(const LayoutParams& params)
+{
+    return params.rows > 0 && params.columns > 0 &&
+        (long long)params.rows * params.columns <= MAX_LAYOUT_SLOTS &&
+        params.spacing >= 2 * CUBE_RADIUS && params.fillProbability >= 0 && params.fillProbability <= 100;
+}
+
+// Function to read layout parameters from the layout file at path into params.
+// The file holds one "name value" pair per line, the names being rows, columns,
+// size (as RxC), spacing and fill; blank lines and lines starting with # are
+// skipped, and parameters not given keep their value in params. Returns 1 on
+// success and 0 if the file cannot be read, has an unknown line or gives a
+// layout that cannot be generated.
+inline int readLayoutFile(const char* path, LayoutParams& params)
+{
+    char line[256], name[64];
+    FILE* file = fopen(path, "r");
+    int ok = 1;
+
+    if (!file)
+        return 0;
+    while (ok && fgets(line, sizeof(line), file))
+    {
+        const char* c = line + strspn(line, " \t\r\n");
+        int used;
+        if (*c == '\0' || *c == '#')
+            continue;
+        if (sscanf(c, "%63s%n", name, &used) != 1)
+            ok = 0;
+        else if (!strcmp(name, "rows"))
+            ok = sscanf(c + used, "%d", &params.rows) == 1;
+        else if (!strcmp(name, "columns"))
+            ok = sscanf(c + used, "%d", &params.columns) == 1;
+        else if (!strcmp(name, "size"))
+            ok = sscanf(c + used, "%dx%d", &params.rows, &params.columns) == 2;
+        else if (!strcmp(name, "spacing"))
+            ok = sscanf(c + used, "%f", &params.spacing) == 1;
+        else if (!strcmp(name, "fill"))
+            ok = sscanf(c + used, "%d", &params.fillProbability) == 1;
+        else
+            ok = 0;
+    }
+    fclose(file);
+    return ok && checkLayoutParams(params);
+}
+
+// Function to parse the layout option at argv[n] into params: --size RxC, --rows
+// R, --columns C, --spacing D, --fill P or --layout <file>. Advances n past the
+// option's value. Returns 1 if an option was parsed and 0 if argv[n] is not a
+// layout option or its value is malformed.
+inline int parseLayoutOption(int& n, int argc, char** argv, LayoutParams& params)
+{
+    if (n + 1 >= argc)
+        return 0;
+    const char* option = argv[n], * value = argv[n + 1];
+    int ok;
+
+    if (!strcmp(option, "--size"))
+        ok = sscanf(value, "%dx%d", &params.rows, &params.columns) == 2;
+    else if (!strcmp(option, "--rows"))
+        ok = sscanf(value, "%d", &params.rows) == 1;
+    else if (!strcmp(option, "--columns"))
+        ok = sscanf(value, "%d", &params.columns) == 1;
+    else if (!strcmp(option, "--spacing"))
+        ok = sscanf(value, "%f", &params.spacing) == 1;
+    else if (!strcmp(option, "--fill"))
+        ok = sscanf(value, "%d", &params.fillProbability) == 1;
+    else if (!strcmp(option, "--layout"))
+        ok = readLayoutFile(value, params);
+    else
+        return 0;
+    if (ok)
+        n++;
+    return ok;
+}
+
+// Header at the start of a level file. It is followed by the blocks written by
+// ObstacleField::write(), each aligned to MAPPED_ALIGNMENT bytes, so the arrays
+// of a mapped level file are used in place as the arrays of the field.
+struct LevelFileHeader
+{
+    char magic[4]; // LEVEL_FILE_MAGIC.
+    uint32_t version; // LEVEL_FILE_VERSION.
+    uint32_t byteOrder; // LEVEL_BYTE_ORDER.
+    uint32_t alignment; // MAPPED_ALIGNMENT.
+    uint64_t fileSize; // Bytes in the whole file, to detect truncation.
+};
+
+// Function to save field, which must have been built, as a level file at path.
+// The file is written next to path and then renamed over it, so processes that
+// have the old file mapped keep their copy. Returns 1 on success and 0 on failure.
+inline int saveLevelFile(const char* path, const ObstacleField& field)
+{
+    std::string temporary = std::string(path) + ".tmp";
+    LevelFileHeader header;
+    FILE* file = fopen(temporary.c_str(), "wb");
+
+    if (!file)
+        return 0;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LEVEL_FILE_MAGIC, 4);
+    header.version = LEVEL_FILE_VERSION;
+    header.byteOrder = LEVEL_BYTE_ORDER;
+    header.alignment = MAPPED_ALIGNMENT;
+
+    BlockWriter out(file, sizeof(header));
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    field.write(out);
+    header.fileSize = out.getOffset();
+    ok = ok && out.isOk() && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+    if (ok)
+        remove(path); // rename() does not replace files on Windows.
+#endif
+    ok = ok && rename(temporary.c_str(), path) == 0;
+    if (!ok)
+        remove(temporary.c_str());
+    return ok;
+}
+
+// Function to map the level file at path and use it as field. Nothing is parsed
+// or copied: the field views the mapped arrays, whose pages are shared with every
+// other process that has the file mapped. The header, the array sizes, the
+// trigger types and radii, and the runs and tree nodes the queries index the cubes
+// with are always checked, so a corrupt file cannot make a query read past the
+// arrays; with verify set, the item lists of the grids, which no query reads, are
+// checked too.
+// Returns 1 on success and 0 if the file cannot be mapped or is not a valid level
+// file of this version, in which case field is left unchanged.
+inline int loadLevelFile(const char* path, ObstacleField& field, int verify = 0)
+{
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    LevelFileHeader header;
+
+    if (!file->open(path) || file->getSize() < sizeof(header))
+        return 0;
+    memcpy(&header, file->getData(), sizeof(header));
+    if (memcmp(header.magic, LEVEL_FILE_MAGIC, 4) || header.version != LEVEL_FILE_VERSION ||
+        header.byteOrder != LEVEL_BYTE_ORDER || header.alignment != MAPPED_ALIGNMENT ||
+        header.fileSize != file->getSize())
+        return 0;
+
+    BlockReader in(file, sizeof(header), verify);
+    return field.read(in);
+}
+
+#endif
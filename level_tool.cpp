@@ -0,0 +1,155 @@
+// Level file tool. Runs headless, no window is opened.
+//
+// Build: g++ -O2 -std=c++17 level_tool.cpp -o level_tool -lpthread
+// Usage: level_tool generate <level file> [--seed S] [--threads N] [--no-sdf] [--size RxC]
+//            [--rows R] [--columns C] [--spacing D] [--fill P] [--layout <file>]
+//        level_tool compile <text level> <level file> [--threads N] [--no-sdf]
+//        level_tool info <level file> [--verify]
+//
+// generate builds a layout the way the game does, on N threads, and saves it as
+// a level file for the game's --level option; the layout is the same for any N.
+// compile does the same with a CSV or JSON text level, see textlevel.h. info
+// maps a level file, runs a few collision queries on it and prints how long
+// loading took, as JSON; --verify checks every index in the file while loading.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "level.h"
+#include "textlevel.h"
+
+// Function to generate a layout with params from seed on threads threads and
+// save it to path.
+static int generateLevel(const char* path, const LayoutParams& params, uint64_t seed, int threads,
+    int bakeDistanceField)
+{
+    ObstacleField field;
+    Pcg32 random(seed, 0);
+
+    auto start = std::chrono::steady_clock::now();
+    field.generateLayout(params, random, threads);
+    auto generated = std::chrono::steady_clock::now();
+    field.bakeDistanceField = bakeDistanceField;
+    field.build(threads);
+    auto built = std::chrono::steady_clock::now();
+    if (!saveLevelFile(path, field))
+    {
+        fprintf(stderr, "Failed to write level file: %s\n", path);
+        return 1;
+    }
+    auto saved = std::chrono::steady_clock::now();
+
+    printf("{\n  \"level\": \"%s\",\n  \"cubes\": %d,\n  \"triggers\": %d,\n  \"broad_phase\": \"%s\",\n"
+        "  \"threads\": %d,\n  \"generate_ms\": %.3f,\n  \"build_ms\": %.3f,\n  \"save_ms\": %.3f\n}\n", path,
+        field.cubes.getCount(), field.triggers.getCount(), field.getUseBVH() ? "bvh" : "grid", threads,
+        std::chrono::duration<double, std::milli>(generated - start).count(),
+        std::chrono::duration<double, std::milli>(built - generated).count(),
+        std::chrono::duration<double, std::milli>(saved - built).count());
+    return 0;
+}
+
+// Function to read the text level at textPath, build it on threads threads and
+// save it to path.
+static int compileLevel(const char* textPath, const char* path, int threads, int bakeDistanceField)
+{
+    ObstacleField field;
+    std::string error;
+
+    auto start = std::chrono::steady_clock::now();
+    if (!readTextLevel(textPath, field, error))
+    {
+        fprintf(stderr, "%s: %s\n", textPath, error.c_str());
+        return 1;
+    }
+    auto parsed = std::chrono::steady_clock::now();
+    field.bakeDistanceField = bakeDistanceField;
+    field.build(threads);
+    auto built = std::chrono::steady_clock::now();
+    if (!saveLevelFile(path, field))
+    {
+        fprintf(stderr, "Failed to write level file: %s\n", path);
+        return 1;
+    }
+    auto saved = std::chrono::steady_clock::now();
+
+    printf("{\n  \"level\": \"%s\",\n  \"source\": \"%s\",\n  \"cubes\": %d,\n  \"triggers\": %d,\n"
+        "  \"broad_phase\": \"%s\",\n  \"parse_ms\": %.3f,\n  \"build_ms\": %.3f,\n  \"save_ms\": %.3f\n}\n", path,
+        textPath, field.cubes.getCount(), field.triggers.getCount(), field.getUseBVH() ? "bvh" : "grid",
+        std::chrono::duration<double, std::milli>(parsed - start).count(),
+        std::chrono::duration<double, std::milli>(built - parsed).count(),
+        std::chrono::duration<double, std::milli>(saved - built).count());
+    return 0;
+}
+
+// Function to load the level file at path and report on it.
+static int describeLevel(const char* path, int verify)
+{
+    ObstacleField field;
+
+    auto start = std::chrono::steady_clock::now();
+    if (!loadLevelFile(path, field, verify))
+    {
+        fprintf(stderr, "Failed to load level file: %s\n", path);
+        return 1;
+    }
+    auto loaded = std::chrono::steady_clock::now();
+
+    // Drive a few poses through the field to show it is usable straight away.
+    int hits = 0;
+    for (int n = 0; n < 1000; n++)
+        hits += field.cubeCarCollision(makeCarPose(0.1f * n - 50.0f, -0.5f * n, 3.0f * n));
+    auto queried = std::chrono::steady_clock::now();
+
+    printf("{\n  \"level\": \"%s\",\n  \"cubes\": %d,\n  \"triggers\": %d,\n  \"broad_phase\": \"%s\",\n"
+        "  \"load_ms\": %.3f,\n  \"first_queries_ms\": %.3f,\n  \"hits\": %d\n}\n", path, field.cubes.getCount(),
+        field.triggers.getCount(), field.getUseBVH() ? "bvh" : "grid",
+        std::chrono::duration<double, std::milli>(loaded - start).count(),
+        std::chrono::duration<double, std::milli>(queried - loaded).count(), hits);
+    return 0;
+}
+
+// Main routine.
+int main(int argc, char** argv)
+{
+    LayoutParams params = makeLayoutParams(8, 6, 100);
+    uint64_t seed = 1;
+    int threads = defaultThreadCount(), bakeDistanceField = 1;
+
+    if ((argc == 3 || (argc == 4 && !strcmp(argv[3], "--verify"))) && !strcmp(argv[1], "info"))
+        return describeLevel(argv[2], argc == 4);
+    if (argc >= 4 && !strcmp(argv[1], "compile"))
+    {
+        int n;
+        for (n = 4; n < argc; n++)
+            if (!strcmp(argv[n], "--threads") && n + 1 < argc && atoi(argv[n + 1]) > 0)
+                threads = atoi(argv[++n]);
+            else if (!strcmp(argv[n], "--no-sdf"))
+                bakeDistanceField = 0;
+            else
+                break;
+        if (n == argc)
+            return compileLevel(argv[2], argv[3], threads, bakeDistanceField);
+    }
+    if (argc >= 3 && !strcmp(argv[1], "generate"))
+    {
+        int n;
+        for (n = 3; n < argc; n++)
+            if (!strcmp(argv[n], "--seed") && n + 1 < argc)
+                seed = strtoull(argv[++n], 0, 10);
+            else if (!strcmp(argv[n], "--threads") && n + 1 < argc && atoi(argv[n + 1]) > 0)
+                threads = atoi(argv[++n]);
+            else if (!strcmp(argv[n], "--no-sdf"))
+                bakeDistanceField = 0;
+            else if (!parseLayoutOption(n, argc, argv, params))
+                break;
+        if (n == argc && checkLayoutParams(params))
+            return generateLevel(argv[2], params, seed, threads, bakeDistanceField);
+    }
+    fprintf(stderr, "Usage: %s generate <level file> [--seed S] [--threads N] [--no-sdf] [--size RxC] [--rows R]\n"
+        "           [--columns C] [--spacing D] [--fill P] [--layout <file>]\n"
+        "       %s compile <text level> <level file> [--threads N] [--no-sdf]\n"
+        "       %s info <level file> [--verify]\n", argv[0], argv[0], argv[0]);
+    return 1;
+}
@@ -0,0 +1,360 @@
+// Arrays that either own their elements or view them in a memory-mapped file,
+// and the aligned block stream that level files are written and read with.
+#ifndef MAPPED_H
+#define MAPPED_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define MAPPED_ALIGNMENT 64 // Alignment in bytes of every block of a mapped file, one cache line.
+
+// Array of plain data that either owns its elements in a std::vector or views
+// elements owned by someone else, such as a mapped file, without copying them.
+// Reading works the same either way. The first change to a viewed array copies
+// the elements into the array, except clear() and assign(), which just drop the
+// view. That includes taking a non-const data() pointer or element reference,
+// so code that only reads a viewed array should do so through a const array or
+// begin().
+template <typename T>
+class MappedArray
+{
+public:
+    MappedArray() { view = 0; count = 0; mapped = 0; }
+    explicit MappedArray(size_t n) : owned(n) { sync(); }
+    MappedArray(const MappedArray& other) : owned(other.owned) { share(other); }
+    MappedArray(MappedArray&& other) noexcept : owned(std::move(other.owned)) { share(other); other.drop(); }
+    MappedArray& operator=(const MappedArray& other) { owned = other.owned; share(other); return *this; }
+    MappedArray& operator=(MappedArray&& other) noexcept;
+    void attach(const T* data, size_t n);
+    int isMapped() const { return mapped; }
+    size_t size() const { return count; }
+    int empty() const { return count == 0; }
+    const T* data() const { return view; }
+    T* data() { own(); return owned.data(); }
+    const T& operator[](size_t k) const { return view[k]; }
+    T& operator[](size_t k) { own(); return owned[k]; }
+    const T* begin() const { return view; }
+    const T* end() const { return view + count; }
+    const T& back() const { return view[count - 1]; }
+    void clear() { drop(); owned.clear(); }
+    void assign(size_t n, const T& value) { drop(); owned.assign(n, value); sync(); }
+    void resize(size_t n) { own(); owned.resize(n); sync(); }
+    void reserve(size_t n) { own(); owned.reserve(n); sync(); }
+    void push_back(const T& value) { own(); owned.push_back(value); sync(); }
+    void swap(MappedArray& other);
+
+private:
+    void sync() { view = owned.data(); count = owned.size(); mapped = 0; }
+    void own() { if (mapped) { owned.assign(view, view + count); sync(); } }
+    void drop() { view = 0; count = 0; mapped = 0; }
+    void share(const MappedArray& other);
+
+    std::vector<T> owned; // Elements, unless viewed.
+    const T* view; // Elements in use: owned.data() or the viewed ones.
+    size_t count; // Number of elements in use.
+    int mapped; // Are the elements viewed rather than owned?
+};
+
+// Function to use the same elements as other: the same view if other is a view,
+// or owned, just copied or moved, elements otherwise.
+template <typename T>
+void MappedArray<T>::share(const MappedArray& other)
+{
+    if (other.mapped)
+    {
+        view = other.view;
+        count = other.count;
+        mapped = 1;
+    }
+    else
+        sync();
+}
+
+// Function to exchange the elements of the array and other. Swapping vectors
+// keeps their buffers, so the views go along with them.
+template <typename T>
+void MappedArray<T>::swap(MappedArray& other)
+{
+    owned.swap(other.owned);
+    std::swap(view, other.view);
+    std::swap(count, other.count);
+    std::swap(mapped, other.mapped);
+}
+
+// MappedArray move assignment. A std::vector keeps its buffer when moved, so a
+// moved view of owned elements stays valid.
+template <typename T>
+MappedArray<T>& MappedArray<T>::operator=(MappedArray&& other) noexcept
+{
+    owned = std::move(other.owned);
+    share(other);
+    other.drop();
+    return *this;
+}
+
+// Function to view the n elements at data, which must outlive the view, instead
+// of the elements of the array.
+template <typename T>
+void MappedArray<T>::attach(const T* data, size_t n)
+{
+    owned.clear();
+    owned.shrink_to_fit();
+    view = data;
+    count = n;
+    mapped = 1;
+}
+
+// Read-only memory mapping of a whole file. The pages are shared with every other
+// process mapping the same file, and only read from disk when first touched.
+class MappedFile
+{
+public:
+    MappedFile() { data = 0; size = 0; }
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    int open(const char* path);
+    void close();
+    const unsigned char* getData() const { return data; }
+    size_t getSize() const { return size; }
+
+private:
+    const unsigned char* data; // First byte of the mapping, or 0.
+    size_t size; // Bytes mapped.
+};
+
+// Function to map the file at path. Returns 1 on success and 0 if the file cannot
+// be opened or mapped, or is empty.
+inline int MappedFile::open(const char* path)
+{
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    LARGE_INTEGER length;
+    if (file == INVALID_HANDLE_VALUE)
+        return 0;
+    if (GetFileSizeEx(file, &length) && length.QuadPart > 0)
+    {
+        HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+        if (mapping)
+        {
+            data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            size = data ? (size_t)length.QuadPart : 0;
+            CloseHandle(mapping); // The view keeps the mapping alive.
+        }
+    }
+    CloseHandle(file);
+#else
+    int file = ::open(path, O_RDONLY);
+    struct stat status;
+    if (file < 0)
+        return 0;
+    if (fstat(file, &status) == 0 && status.st_size > 0)
+    {
+        void* mapping = mmap(0, (size_t)status.st_size, PROT_READ, MAP_SHARED, file, 0);
+        if (mapping != MAP_FAILED)
+        {
+            data = (const unsigned char*)mapping;
+            size = (size_t)status.st_size;
+        }
+    }
+    ::close(file); // The mapping keeps the file open.
+#endif
+    return data != 0;
+}
+
+// Function to unmap the file, if one is mapped.
+inline void MappedFile::close()
+{
+    if (!data)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap((void*)data, size);
+#endif
+    data = 0;
+    size = 0;
+}
+
+// Header of each block of a mapped file. The elements follow at the next
+// multiple of MAPPED_ALIGNMENT bytes.
+struct MappedBlockHeader
+{
+    uint64_t count; // Number of elements.
+    uint32_t elementSize; // Bytes per element, checked when the block is read.
+    uint32_t reserved;
+};
+
+// Writer of a stream of blocks of plain data, each aligned to MAPPED_ALIGNMENT
+// bytes so that a reader can use the mapped elements in place.
+class BlockWriter
+{
+public:
+    BlockWriter(FILE* file, uint64_t offset) : file(file), offset(offset), remaining(0), ok(1) {}
+    template <typename T>
+    void value(const T& v) { array(&v, 1); }
+    template <typename T>
+    void array(const T* data, size_t count) { begin<T>(count); append(data, count); }
+    template <typename T>
+    void begin(size_t count);
+    template <typename T>
+    void append(const T* data, size_t count) { write(data, count * sizeof(T)); }
+    void appendZeros(size_t bytes);
+    int isOk() const { return ok && remaining == 0; }
+    uint64_t getOffset() const { return offset; }
+
+private:
+    void write(const void* data, size_t bytes);
+    void pad();
+
+    FILE* file;
+    uint64_t offset; // Bytes written to file so far.
+    uint64_t remaining; // Bytes of the current block still to be appended.
+    int ok; // Have all writes succeeded?
+};
+
+// Function to start a block of count elements, to be given with append().
+template <typename T>
+void BlockWriter::begin(size_t count)
+{
+    MappedBlockHeader header = { count, (uint32_t)sizeof(T), 0 };
+
+    if (remaining != 0)
+        ok = 0; // The previous block was left short.
+    pad();
+    remaining = 0;
+    write(&header, sizeof(header));
+    pad();
+    remaining = count * sizeof(T);
+}
+
+// Function to append bytes zero bytes to the current block.
+inline void BlockWriter::appendZeros(size_t bytes)
+{
+    static const unsigned char zeros[MAPPED_ALIGNMENT] = { 0 };
+
+    while (bytes > 0)
+    {
+        size_t chunk = bytes < sizeof(zeros) ? bytes : sizeof(zeros);
+        write(zeros, chunk);
+        bytes -= chunk;
+    }
+}
+
+// Function to write bytes bytes of data at the end of the file.
+inline void BlockWriter::write(const void* data, size_t bytes)
+{
+    if (bytes == 0)
+        return;
+    if (bytes > remaining && remaining != 0)
+        ok = 0; // More than the block was started with.
+    ok = ok && fwrite(data, bytes, 1, file) == 1;
+    offset += bytes;
+    remaining = remaining > bytes ? remaining - bytes : 0;
+}
+
+// Function to write zeros up to the next multiple of MAPPED_ALIGNMENT bytes.
+inline void BlockWriter::pad()
+{
+    static const unsigned char zeros[MAPPED_ALIGNMENT] = { 0 };
+    size_t bytes = (size_t)((MAPPED_ALIGNMENT - offset % MAPPED_ALIGNMENT) % MAPPED_ALIGNMENT);
+
+    ok = ok && (bytes == 0 || fwrite(zeros, bytes, 1, file) == 1);
+    offset += bytes;
+}
+
+// Reader of the blocks written by BlockWriter from a mapped file. Arrays are
+// attached to the mapped elements rather than copied, and keep referring to
+// them for as long as the file stays mapped; getFile() gives the owner of the
+// arrays a share in the mapping. Readers always check the sizes of what they
+// read, and only check every element if isVerifying(), since that touches the
+// whole file.
+class BlockReader
+{
+public:
+    BlockReader(std::shared_ptr<const MappedFile> file, uint64_t offset, int verify = 0) :
+        file(file), offset(offset), verify(verify) {}
+    int isVerifying() const { return verify; }
+    template <typename T>
+    int value(T& v);
+    template <typename T>
+    int array(MappedArray<T>& out);
+    const std::shared_ptr<const MappedFile>& getFile() const { return file; }
+
+private:
+    template <typename T>
+    const T* next(uint64_t& count);
+
+    std::shared_ptr<const MappedFile> file;
+    uint64_t offset; // Bytes of the file read so far.
+    int verify; // Check every element read?
+};
+
+// Function returning the elements of the next block and setting count to their
+// number, or returning 0 if the next block does not hold elements of type T or
+// runs past the end of the file.
+template <typename T>
+const T* BlockReader::next(uint64_t& count)
+{
+    MappedBlockHeader header;
+    uint64_t size = file->getSize();
+
+    offset = (offset + MAPPED_ALIGNMENT - 1) / MAPPED_ALIGNMENT * MAPPED_ALIGNMENT;
+    if (offset > size || size - offset < sizeof(header))
+        return 0;
+    memcpy(&header, file->getData() + offset, sizeof(header));
+    offset = (offset + sizeof(header) + MAPPED_ALIGNMENT - 1) / MAPPED_ALIGNMENT * MAPPED_ALIGNMENT;
+    if (header.elementSize != sizeof(T) || offset > size || header.count > (size - offset) / sizeof(T))
+        return 0;
+    count = header.count;
+    const T* data = (const T*)(file->getData() + offset);
+    offset += header.count * sizeof(T);
+    return data;
+}
+
+// Function to read the next block, which must hold exactly one element, into v.
+// Returns 1 on success and 0 otherwise.
+template <typename T>
+int BlockReader::value(T& v)
+{
+    uint64_t count;
+    const T* data = next<T>(count);
+
+    if (!data || count != 1)
+        return 0;
+    memcpy(&v, data, sizeof(T));
+    return 1;
+}
+
+// Function to attach out to the elements of the next block. Returns 1 on success
+// and 0 otherwise.
+template <typename T>
+int BlockReader::array(MappedArray<T>& out)
+{
+    uint64_t count;
+    const T* data = next<T>(count);
+
+    if (!data)
+        return 0;
+    out.attach(data, (size_t)count);
+    return 1;
+}
+
+#endif
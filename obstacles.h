@@ -0,0 +1,549 @@
+// Obstacle layout of the car game and the collision queries against it. Needs
+// no OpenGL, so it can also be used headless.
+#ifndef OBSTACLES_H
+#define OBSTACLES_H
+
+#ifndef _USE_MATH_DEFINES
+#define _USE_MATH_DEFINES
+#endif
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "collision.h"
+#include "bvh.h"
+#include "sdf.h"
+#include "triggers.h"
+#include "parallel.h"
+#include "pcg.h"
+#include "vehicle.h"
+
+#define GRID_CELL_SIZE 30.0 // Edge length of a collision broad-phase grid cell.
+#define GRID_MAX_CELLS_PER_CUBE 4 // Sparser layouts use the BVH broad-phase instead of the grid.
+#define SDF_CELL_SIZE 1.0 // Edge length of a distance field texel.
+#define CACHE_PADDING 10.0 // Distance the car can move before the collision cache is refilled.
+#define CAR_HALF_WIDTH 3.0 // Half the width of the car body drawn in drawCar().
+#define CAR_HALF_LENGTH 5.5 // Half the length of the car body drawn in drawCar().
+#define CAR_RADIUS 6.265 // Radius of the bounding sphere of the car body.
+#define SWEPT_TURN_TOLERANCE 0.05f // Most the car body is grown by to sweep a turn, unless split too often.
+#define SWEPT_MAX_PIECES 16 // Most pieces a turning move is swept in.
+#define BATCH_GROUP_EXTENT 60.0 // Widest spread of the poses checked together by cubeCarCollisionBatch().
+#define CUBE_SPACING 30.0f // Default distance between neighbouring cube slots.
+#define CUBE_RADIUS 3.0f // Half the edge length of a cube.
+#define LAYOUT_START_Z -40.0f // z co-ordinate of the first row of cube slots.
+#define LAYOUT_TILE_SLOTS 64 // Slots along each edge of a tile of a generated layout.
+
+// Size and density of a generated layout, chosen at run time.
+struct LayoutParams
+{
+    int32_t rows, columns; // Cube slots in front of the car and across.
+    float spacing; // Distance between neighbouring slots.
+    int32_t fillProbability; // Percentage probability that a slot holds a cube.
+};
+
+// Function returning layout parameters for rows x columns slots spacing apart,
+// each filled with fillProbability percent probability.
+inline LayoutParams makeLayoutParams(int rows, int columns, int fillProbability, float spacing = CUBE_SPACING)
+{
+    LayoutParams params;
+    params.rows = rows;
+    params.columns = columns;
+    params.spacing = spacing;
+    params.fillProbability = fillProbability;
+    return params;
+}
+
+// Pose of the car together with the quantities derived from it that the collision
+// queries, the camera and the lights all need. Built once whenever the pose
+// changes, so none of them recompute the trigonometry of the heading.
+struct CarPose
+{
+    float x, z; // Center of the base of the car.
+    float angle; // Angle of the car to the -z direction in degrees.
+    float headingX, headingZ; // Unit vector the car faces, (-sin(angle), -cos(angle)).
+    float sphereX, sphereZ; // Center of the bounding sphere of radius CAR_RADIUS around the body.
+};
+
+// Function returning the pose of the car at (x, z) with heading angle in degrees,
+// given the unit vector (headingX, headingZ) it faces.
+inline CarPose makeCarPose(float x, float z, float angle, float headingX, float headingZ)
+{
+    CarPose pose;
+    pose.x = x;
+    pose.z = z;
+    pose.angle = angle;
+    pose.headingX = headingX;
+    pose.headingZ = headingZ;
+    pose.sphereX = x; // The body is centered on the base of the car.
+    pose.sphereZ = z;
+    return pose;
+}
+
+// Function returning the pose of the car at (x, z) with heading angle in degrees.
+// The heading is computed like the vehicle model does, so the pose is the one the
+// model gives for the same angle.
+inline CarPose makeCarPose(float x, float z, float angle)
+{
+    float sine, cosine;
+    vehicleSinCos(angle, sine, cosine);
+    return makeCarPose(x, z, angle, -sine, -cosine);
+}
+
+// Cubes and trigger areas of a level together with their collision structures.
+// The queries are const but not all of them are safe to run at once from several
+// threads: cubeCarCollision() and sweptCubeCarCollision() refill the run cache
+// around the car, so a field may only be driven through by one thread at a time.
+// queryCubes(), cubeCarCollisionBatch(), raycastCubes(), cubeClearance() and
+// triggerCollision() only read the field and can be called from any number of
+// threads. WorldBatch gives every world its own field, stepped by one thread, and
+// a ChunkedWorld only queries a chunk once the worker has handed it over.
+class ObstacleField
+{
+public:
+    ObstacleField();
+    void generateLayout(const LayoutParams& params, Pcg32& random, int threads = defaultThreadCount());
+    void build(int threads = defaultThreadCount());
+    void write(BlockWriter& out) const;
+    int read(BlockReader& in);
+    int cubeCarCollision(const CarPose& pose) const;
+    int cubeCarCollision(float x, float z, float a) const { return cubeCarCollision(makeCarPose(x, z, a)); }
+    int cubeCarCollisionBatch(const CarPose* poses, int count, unsigned char* hits) const;
+    int cubeCarCollisionBatch(const float* x, const float* z, const float* a, int count,
+        unsigned char* hits) const;
+    float sweptCubeCarCollision(const CarPose& from, const CarPose& to) const;
+    float sweptCubeCarCollision(float x0, float z0, float a0, float x1, float z1, float a1) const
+    {
+        return sweptCubeCarCollision(makeCarPose(x0, z0, a0), makeCarPose(x1, z1, a1));
+    }
+    int triggerCollision(float x, float z, unsigned char* reached) const;
+    float cubeClearance(float x, float z) const { return distanceField.clearance(x, z); }
+    float raycastCubes(float x, float z, float dirX, float dirZ, float maxDistance) const;
+    template <typename Visit>
+    int queryCubes(float minX, float minZ, float maxX, float maxZ, Visit visit) const;
+    int getUseBVH() const { return useBVH; }
+
+    CubeStore cubes; // Cubes, kept in the order of the broad-phase in use after build().
+    TriggerStore triggers; // Goals, checkpoints and hazards, ordered like the cubes.
+    int bakeDistanceField; // Bake a distance field of the cubes in build()?
+
+private:
+    template <typename Visit>
+    int queryCubesNearCar(float minX, float minZ, float maxX, float maxZ, Visit visit) const;
+
+    UniformGrid cubeGrid; // Broad-phase grid over cubes.
+    SphereBVH cubeBVH; // Broad-phase BVH over cubes.
+    int useBVH; // Is the BVH rather than the grid the broad-phase?
+    DistanceField distanceField; // Distance field of cubes, if baked.
+    mutable RunCache cubeCache; // Runs of cubes near the car from the last collision query, see above.
+    UniformGrid triggerGrid; // Broad-phase grid over triggers.
+    SphereBVH triggerBVH; // Broad-phase BVH over triggers.
+    std::shared_ptr<const MappedFile> mapping; // Level file the arrays were read from, if any.
+};
+
+// ObstacleField constructor.
+inline ObstacleField::ObstacleField()
+{
+    bakeDistanceField = 1;
+    useBVH = 0;
+}
+
+// Function to call emit(x, z, red, green, blue) for each cube of tile tile of a
+// layout with params, in order, drawing from stream tile of seed. Tiles are
+// LAYOUT_TILE_SLOTS slots square and numbered down the rows of each column of
+// tiles in turn, across tileRows rows of tiles.
+template <typename Emit>
+void generateLayoutTile(const LayoutParams& params, uint64_t seed, int tile, int tileRows, Emit emit)
+{
+    Pcg32 random(seed, (uint64_t)tile);
+    int firstRow = tile % tileRows * LAYOUT_TILE_SLOTS, firstColumn = tile / tileRows * LAYOUT_TILE_SLOTS;
+    int lastRow = std::min(firstRow + LAYOUT_TILE_SLOTS, (int)params.rows);
+    int lastColumn = std::min(firstColumn + LAYOUT_TILE_SLOTS, (int)params.columns);
+
+    for (int j = firstColumn; j < lastColumn; j++)
+        for (int i = firstRow; i < lastRow; i++)
+            if ((int)random.nextBelow(100) < params.fillProbability)
+            {
+                // Draw the color one component at a time, so the order is fixed.
+                unsigned char red = random.nextBelow(256);
+                unsigned char green = random.nextBelow(256);
+                unsigned char blue = random.nextBelow(256);
+
+                emit(params.spacing * (j - (params.columns - 1) / 2.0f), LAYOUT_START_Z - params.spacing * i,
+                    red, green, blue);
+            }
+}
+
+// Function to fill the field with params.rows x params.columns slots of cubes in
+// front of the car, each filled with a cube with params.fillProbability percent
+// probability, and the goal. The columns are centered on the car. The slots are
+// split into tiles, each drawing from its own stream of one seed taken from
+// random, and the tiles are generated on up to threads threads: once to count
+// their cubes, so that every tile knows where its cubes go, and once to store
+// them. The cubes come out in the order of the tiles, so the layout depends only
+// on the state of random and not on the number of threads. build() must be
+// called afterwards.
+inline void ObstacleField::generateLayout(const LayoutParams& params, Pcg32& random, int threads)
+{
+    int tileRows = (params.rows + LAYOUT_TILE_SLOTS - 1) / LAYOUT_TILE_SLOTS;
+    int tileColumns = (params.columns + LAYOUT_TILE_SLOTS - 1) / LAYOUT_TILE_SLOTS, tiles = tileRows * tileColumns;
+    uint64_t seed = (uint64_t)random.next() << 32;
+    std::vector<int> tileStart(tiles + 1);
+
+    seed |= random.next();
+    parallelFor(tiles, threads, [&](int begin, int end)
+        {
+            for (int t = begin; t < end; t++)
+            {
+                int cubesInTile = 0;
+                generateLayoutTile(params, seed, t, tileRows,
+                    [&](float, float, unsigned char, unsigned char, unsigned char) { cubesInTile++; });
+                tileStart[t + 1] = cubesInTile;
+            }
+        });
+    tileStart[0] = 0;
+    for (int t = 0; t < tiles; t++)
+        tileStart[t + 1] += tileStart[t];
+
+    cubes.clear();
+    cubes.resize(tileStart[tiles]);
+    parallelFor(tiles, threads, [&](int begin, int end)
+        {
+            for (int t = begin; t < end; t++)
+            {
+                int k = tileStart[t];
+                generateLayoutTile(params, seed, t, tileRows,
+                    [&](float x, float z, unsigned char red, unsigned char green, unsigned char blue)
+                    {
+                        cubes.set(k++, x, 0.0, z, CUBE_RADIUS, red, green, blue);
+                    });
+            }
+        });
+
+    triggers.clear();
+    triggers.add(3.0, -95.0, 10.0, TRIGGER_GOAL);
+}
+
+// Function to build the collision structures over the current cubes and triggers,
+// baking the distance field on up to threads threads.
+inline void ObstacleField::build(int threads)
+{
+    // Use the grid for dense layouts and the BVH for sparse ones, where most grid
+    // cells would be empty.
+    useBVH = UniformGrid::countCells(cubes.getX(), cubes.getZ(), cubes.getR(),
+        cubes.getCount(), GRID_CELL_SIZE) > GRID_MAX_CELLS_PER_CUBE * cubes.getCount();
+    if (useBVH)
+    {
+        buildCubeBVH(cubes, cubeBVH);
+        buildTriggerBVH(triggers, triggerBVH);
+    }
+    else
+    {
+        buildCubeGrid(cubes, cubeGrid, GRID_CELL_SIZE);
+        buildTriggerGrid(triggers, triggerGrid, GRID_CELL_SIZE);
+    }
+    cubeCache.invalidate();
+
+    // Optionally bake the distance field that lets most collision queries finish
+    // with one lookup.
+    if (bakeDistanceField)
+        distanceField.bake(cubes, SDF_CELL_SIZE, 2 * CAR_RADIUS, threads);
+    else
+        distanceField = DistanceField();
+}
+
+// Function to write the cubes, triggers and collision structures built by build()
+// to out, in the order read() expects them.
+inline void ObstacleField::write(BlockWriter& out) const
+{
+    out.value(useBVH);
+    cubes.write(out);
+    triggers.write(out);
+    if (useBVH)
+    {
+        cubeBVH.write(out);
+        triggerBVH.write(out);
+    }
+    else
+    {
+        cubeGrid.write(out);
+        triggerGrid.write(out);
+    }
+    distanceField.write(out);
+}
+
+// Function to read a field written by write() from in. The arrays stay in the
+// mapped file, which the field keeps mapped, so nothing has to be built or
+// copied. Returns 1 on success and 0 if the blocks do not hold a field, in which
+// case the field is left unchanged.
+inline int ObstacleField::read(BlockReader& in)
+{
+    ObstacleField loaded;
+
+    if (!in.value(loaded.useBVH) || !loaded.cubes.read(in) || !loaded.triggers.read(in))
+        return 0;
+    if (loaded.useBVH ? !loaded.cubeBVH.read(in, loaded.cubes.getCount()) ||
+        !loaded.triggerBVH.read(in, loaded.triggers.getCount()) :
+        !loaded.cubeGrid.read(in, loaded.cubes.getCount()) || !loaded.triggerGrid.read(in, loaded.triggers.getCount()))
+        return 0;
+    if (!loaded.distanceField.read(in))
+        return 0;
+    loaded.bakeDistanceField = loaded.distanceField.getWidth() > 0;
+    loaded.mapping = in.getFile();
+    *this = std::move(loaded);
+    return 1;
+}
+
+// Function to call visit(begin, end) with runs of consecutive cubes covering every
+// cube that may overlap the rectangle [minX, maxX] x [minZ, maxZ], using whichever
+// broad-phase build() chose. Stops at and returns the first nonzero result. Both
+// bound a cube by the square of its half edge around its center, which is its
+// whole footprint, so a rectangle around the car's bounding circle finds every
+// cube the body can touch.
+template <typename Visit>
+int ObstacleField::queryCubes(float minX, float minZ, float maxX, float maxZ, Visit visit) const
+{
+    if (useBVH)
+        return cubeBVH.queryRanges(minX, minZ, maxX, maxZ, visit);
+    return cubeGrid.queryRanges(minX, minZ, maxX, maxZ, visit);
+}
+
+// Function like queryCubes() for queries that follow the car. The runs around the
+// car are cached with CACHE_PADDING to spare, and the broad-phase is only walked
+// again once a query reaches past the cached region.
+template <typename Visit>
+int ObstacleField::queryCubesNearCar(float minX, float minZ, float maxX, float maxZ, Visit visit) const
+{
+    if (!cubeCache.covers(minX, minZ, maxX, maxZ))
+        cubeCache.refill(minX - CACHE_PADDING, minZ - CACHE_PADDING, maxX + CACHE_PADDING, maxZ + CACHE_PADDING,
+            [&](float x0, float z0, float x1, float z1, auto collect) { return queryCubes(x0, z0, x1, z1, collect); });
+    return cubeCache.visitRuns(visit);
+}
+
+// Function to check if the car in pose collides with a cube. If the distance
+// field is baked, a car farther than its bounding radius from every cube is
+// cleared with one lookup. Otherwise only the runs of cubes cached around the
+// car, or found in the broad-phase under it, are tested. The bounding
+// sphere of the car body is checked first with the batch sphere kernel, and only
+// the cubes it touches get the exact test against the car body box.
+inline int ObstacleField::cubeCarCollision(const CarPose& pose) const
+{
+    float x = pose.sphereX, z = pose.sphereZ;
+
+    if (distanceField.getWidth() && distanceField.clearance(x, z) > CAR_RADIUS)
+        return 0;
+
+    float cosA = -pose.headingZ, sinA = -pose.headingX;
+
+    // Check for collision with each nearby cube.
+    return queryCubesNearCar(x - CAR_RADIUS, z - CAR_RADIUS, x + CAR_RADIUS, z + CAR_RADIUS,
+        [&](int begin, int end)
+        {
+            return findBoxOverlap(cubes, begin, end, pose.x, pose.z, cosA, sinA,
+                CAR_HALF_WIDTH, CAR_HALF_LENGTH) >= 0;
+        });
+}
+
+// Function to check count candidate car poses at once, setting hits[n] to 1 if
+// poses[n] collides with a cube and to 0 otherwise. Returns the number of colliding
+// poses. Poses the distance field clears are settled with one lookup each. The
+// rest are gathered into groups of up to SIMD_WIDTH that lie within
+// BATCH_GROUP_EXTENT of each other. The broad-phase is walked once for the box
+// around a whole group, and each cube found is tested against all the poses of
+// the group at once with the pose kernel before the exact box test. Nearby poses,
+// such as a planner's candidates around the car, therefore cost little more than
+// a single query. Poses are grouped in the order given, so callers should pass
+// nearby poses next to each other; scattered poses fall into groups of one and
+// cost about as much as cubeCarCollision().
+inline int ObstacleField::cubeCarCollisionBatch(const CarPose* poses, int count, unsigned char* hits) const
+{
+    float poseX[SIMD_WIDTH], poseZ[SIMD_WIDTH], cosA[SIMD_WIDTH], sinA[SIMD_WIDTH];
+    float boundingRadius = std::sqrt(CAR_HALF_WIDTH * CAR_HALF_WIDTH + CAR_HALF_LENGTH * CAR_HALF_LENGTH);
+    float minX = 0.0, minZ = 0.0, maxX = 0.0, maxZ = 0.0;
+    int group[SIMD_WIDTH], l, n, next, pending, numHits = 0;
+
+    for (next = 0; next < count;)
+    {
+        // Gather the next poses while their box stays small.
+        for (n = 0; n < SIMD_WIDTH && next < count; next++)
+        {
+            const CarPose& pose = poses[next];
+            if (distanceField.getWidth() && distanceField.clearance(pose.sphereX, pose.sphereZ) > CAR_RADIUS)
+            {
+                hits[next] = 0;
+                continue;
+            }
+            if (n == 0)
+            {
+                minX = maxX = pose.x;
+                minZ = maxZ = pose.z;
+            }
+            else if (fmaxf(maxX, pose.x) - fminf(minX, pose.x) > BATCH_GROUP_EXTENT ||
+                fmaxf(maxZ, pose.z) - fminf(minZ, pose.z) > BATCH_GROUP_EXTENT)
+                break;
+            group[n] = next;
+            poseX[n] = pose.x;
+            poseZ[n] = pose.z;
+            cosA[n] = -pose.headingZ;
+            sinA[n] = -pose.headingX;
+            minX = fminf(minX, pose.x);
+            minZ = fminf(minZ, pose.z);
+            maxX = fmaxf(maxX, pose.x);
+            maxZ = fmaxf(maxZ, pose.z);
+            n++;
+        }
+        if (n == 0)
+            continue; // The distance field cleared every pose left.
+        for (l = n; l < SIMD_WIDTH; l++)
+            poseX[l] = poseZ[l] = 1.0e30f; // Unused lane, far from every cube.
+
+        pending = (1 << n) - 1; // Poses not known to collide yet.
+        queryCubes(minX - boundingRadius, minZ - boundingRadius, maxX + boundingRadius, maxZ + boundingRadius,
+            [&](int begin, int end)
+            {
+                for (int k = begin; k < end; k++)
+                {
+                    int mask = findPosesOverlap(poseX, poseZ, boundingRadius, cubes.getX()[k],
+                        cubes.getY()[k], cubes.getZ()[k], CUBE_FOOTPRINT_SCALE * cubes.getR()[k]) & pending;
+                    for (; mask; mask &= mask - 1)
+                    {
+                        int lane = lowestBit(mask);
+                        if (checkBoxCubeIntersection(poseX[lane], poseZ[lane], cosA[lane], sinA[lane],
+                            CAR_HALF_WIDTH, CAR_HALF_LENGTH, cubes.getX()[k], cubes.getZ()[k],
+                            cubes.getR()[k]))
+                            pending &= ~(1 << lane);
+                    }
+                }
+                return pending == 0; // Stop once every pose collides.
+            });
+
+        for (l = 0; l < n; l++)
+        {
+            hits[group[l]] = !(pending & (1 << l));
+            numHits += hits[group[l]];
+        }
+    }
+    return numHits;
+}
+
+// Function like cubeCarCollisionBatch() above for poses (x[n], z[n], a[n]).
+inline int ObstacleField::cubeCarCollisionBatch(const float* x, const float* z, const float* a, int count,
+    unsigned char* hits) const
+{
+    std::vector<CarPose> poses(count);
+    for (int n = 0; n < count; n++)
+        poses[n] = makeCarPose(x[n], z[n], a[n]);
+    return cubeCarCollisionBatch(poses.data(), count, hits);
+}
+
+// Function returning the time of impact in [0, 1] at which the car body first
+// touches a cube as the car moves from pose from to pose to, or NO_IMPACT if the
+// whole motion is clear. The car moves in a straight line while its heading turns
+// evenly from that of from to that of to. The move is swept in pieces, each with
+// the heading halfway through it and the body grown by the most a corner strays
+// from that heading, so large steps cannot tunnel through a cube and a turn cannot
+// clip a corner through one. A turn is split until the body is grown by at most
+// SWEPT_TURN_TOLERANCE, or into SWEPT_MAX_PIECES pieces.
+inline float ObstacleField::sweptCubeCarCollision(const CarPose& from, const CarPose& to) const
+{
+    float x0 = from.x, z0 = from.z, x1 = to.x, z1 = to.z;
+
+    // No cube can be reached if the clearance at the start exceeds the move. The
+    // body stays within CAR_RADIUS of its center whatever its heading.
+    if (distanceField.getWidth() && distanceField.clearance(from.sphereX, from.sphereZ) > CAR_RADIUS + hypot(x1 - x0, z1 - z0))
+        return NO_IMPACT;
+
+    // A corner turned by an angle in radians moves by at most CAR_RADIUS times it,
+    // and each piece turns at most half its share of the turn off its heading.
+    float turn = fabsf(to.angle - from.angle) * (float)(M_PI / 180.0);
+    int pieces = std::min(std::max((int)std::ceil(CAR_RADIUS * turn / (2 * SWEPT_TURN_TOLERANCE)), 1), SWEPT_MAX_PIECES);
+    float grow = (float)(CAR_RADIUS * turn / (2 * pieces));
+    float pieceX[SWEPT_MAX_PIECES + 1], pieceZ[SWEPT_MAX_PIECES + 1], cosA[SWEPT_MAX_PIECES], sinA[SWEPT_MAX_PIECES];
+    int n;
+
+    for (n = 0; n < pieces; n++)
+    {
+        float t = (float)n / pieces;
+        pieceX[n] = x0 + t * (x1 - x0);
+        pieceZ[n] = z0 + t * (z1 - z0);
+        if (turn == 0.0f)
+        {
+            cosA[n] = -to.headingZ;
+            sinA[n] = -to.headingX;
+        }
+        else
+            vehicleSinCos(from.angle + (n + 0.5f) / pieces * (to.angle - from.angle), sinA[n], cosA[n]);
+    }
+    pieceX[pieces] = x1;
+    pieceZ[pieces] = z1;
+
+    // Keep the earliest impact over all the cubes near the swept path, trying the
+    // pieces in order and stopping at the first one that hits.
+    float first = NO_IMPACT;
+    queryCubesNearCar(fmin(x0, x1) - CAR_RADIUS - grow, fmin(z0, z1) - CAR_RADIUS - grow,
+        fmax(x0, x1) + CAR_RADIUS + grow, fmax(z0, z1) + CAR_RADIUS + grow,
+        [&](int begin, int end)
+        {
+            for (int k = 0; k < pieces && (float)k / pieces < first; k++)
+            {
+                float t = findSweptBoxImpact(cubes, begin, end, pieceX[k], pieceZ[k], pieceX[k + 1], pieceZ[k + 1],
+                    cosA[k], sinA[k], CAR_HALF_WIDTH + grow, CAR_HALF_LENGTH + grow);
+                if (t <= 1.0f)
+                {
+                    first = fmin(first, (k + t) / pieces);
+                    break;
+                }
+            }
+            return first == 0.0; // Stop early once touching at the start.
+        });
+    return first;
+}
+
+// Function to check which trigger areas contain the car at (x, 0, z). Returns a
+// bitmask with bit (1 << type) set for each type of trigger found, and if reached
+// is given sets reached[k] for each trigger k found. Only the triggers in the
+// broad-phase under the car are checked.
+inline int ObstacleField::triggerCollision(float x, float z, unsigned char* reached) const
+{
+    int mask = 0;
+    auto visit = [&](int begin, int end)
+        {
+            mask |= findTriggers(triggers, begin, end, x, z, [&](int k)
+                {
+                    if (reached)
+                        reached[k] = 1;
+                });
+            return 0;
+        };
+
+    if (useBVH)
+        triggerBVH.queryRanges(x, z, x, z, visit);
+    else
+        triggerGrid.queryRanges(x, z, x, z, visit);
+    return mask;
+}
+
+// Function returning the distance from (x, 0, z) along the unit direction
+// (dirX, 0, dirZ) to the nearest cube, or maxDistance if no cube is that close.
+inline float ObstacleField::raycastCubes(float x, float z, float dirX, float dirZ, float maxDistance) const
+{
+    if (useBVH)
+        return cubeBVH.raycast(x, z, dirX, dirZ, maxDistance, [&](int begin, int end, float limit)
+            {
+                return findRayImpact(cubes, begin, end, x, z, dirX, dirZ, limit);
+            });
+
+    // The grid has no ray traversal, so visit the cells under the bounding box of the ray.
+    float endX = x + maxDistance * dirX, endZ = z + maxDistance * dirZ;
+    queryCubes(fmin(x, endX), fmin(z, endZ), fmax(x, endX), fmax(z, endZ), [&](int begin, int end)
+        {
+            maxDistance = findRayImpact(cubes, begin, end, x, z, dirX, dirZ, maxDistance);
+            return 0;
+        });
+    return maxDistance;
+}
+
+#endif
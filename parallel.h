@@ -0,0 +1,148 @@
+// Helpers for running loops on all cores.
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Function returning the number of worker threads to use by default.
+inline int defaultThreadCount()
+{
+    unsigned int n = std::thread::hardware_concurrency();
+    return n > 0 ? (int)n : 1;
+}
+
+// Function to split [0, count) into at most threads contiguous blocks and call
+// body(begin, end) for each block on its own thread. The calling thread runs the
+// first block itself, and the function returns when all blocks are done.
+template <typename Body>
+void parallelFor(int count, int threads, Body body)
+{
+    if (threads > count)
+        threads = count;
+    if (threads <= 1)
+    {
+        if (count > 0)
+            body(0, count);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++)
+        workers.emplace_back([&, t]() { body((int)((long long)count * t / threads),
+            (int)((long long)count * (t + 1) / threads)); });
+    body(0, count / threads);
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+// Fixed set of worker threads that run parallel loops one after another. Unlike
+// parallelFor() the threads are started once and then wait for work, so loops
+// that are run very often, such as one per simulation step, do not pay for
+// thread creation each time.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int threads = defaultThreadCount());
+    ~ThreadPool();
+    void run(int count, const std::function<void(int, int)>& body);
+    int getThreadCount() const { return (int)workers.size() + 1; }
+
+private:
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    void work(int index);
+
+    std::vector<std::thread> workers; // The calling thread of run() is thread 0.
+    std::mutex mutex;
+    std::condition_variable started, finished;
+    const std::function<void(int, int)>* task; // Body of the loop being run.
+    int taskCount; // Size of the loop being run.
+    unsigned int generation; // Number of loops started.
+    int pending; // Workers still running their block of the current loop.
+    int stopping; // Should the workers exit?
+};
+
+// ThreadPool constructor. Starts threads - 1 workers.
+inline ThreadPool::ThreadPool(int threads)
+{
+    task = 0;
+    taskCount = 0;
+    generation = 0;
+    pending = 0;
+    stopping = 0;
+    for (int t = 1; t < threads; t++)
+        workers.emplace_back(&ThreadPool::work, this, t);
+}
+
+// ThreadPool destructor. Waits for the workers to exit.
+inline ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = 1;
+    }
+    started.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+// Function run by worker index: waits for each loop and runs its block of it.
+inline void ThreadPool::work(int index)
+{
+    unsigned int seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+
+    for (;;)
+    {
+        started.wait(lock, [&]() { return stopping || generation != seen; });
+        if (stopping)
+            return;
+        seen = generation;
+        int threads = getThreadCount(), count = taskCount;
+        const std::function<void(int, int)>& body = *task;
+        lock.unlock();
+
+        int begin = (int)((long long)count * index / threads), end = (int)((long long)count * (index + 1) / threads);
+        if (begin < end)
+            body(begin, end);
+
+        lock.lock();
+        if (--pending == 0)
+            finished.notify_one();
+    }
+}
+
+// Function to split [0, count) into one contiguous block per thread and call
+// body(begin, end) for each block, like parallelFor(). The calling thread runs
+// the first block itself, and the function returns when all blocks are done.
+inline void ThreadPool::run(int count, const std::function<void(int, int)>& body)
+{
+    if (workers.empty() || count <= 1)
+    {
+        if (count > 0)
+            body(0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = &body;
+        taskCount = count;
+        pending = (int)workers.size();
+        generation++;
+    }
+    started.notify_all();
+
+    int end = (int)((long long)count / getThreadCount());
+    if (end > 0)
+        body(0, end);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&]() { return pending == 0; });
+}
+
+#endif
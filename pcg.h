@@ -0,0 +1,57 @@
+// Small seedable random number generator for layouts.
+#ifndef PCG_H
+#define PCG_H
+
+#include <cstdint>
+
+// PCG32 generator (O'Neill, "PCG: A family of simple fast space-efficient
+// statistically good algorithms for random number generation"). 64 bits of
+// state and an odd increment selecting one of 2^63 independent streams, so every
+// world or tile can own a generator without sharing anything, and the same seed
+// and stream always give the same numbers.
+class Pcg32
+{
+public:
+    Pcg32() { seed(0, 0); }
+    Pcg32(uint64_t initState, uint64_t stream) { seed(initState, stream); }
+    void seed(uint64_t initState, uint64_t stream);
+    uint32_t next();
+    uint32_t nextBelow(uint32_t bound);
+
+private:
+    uint64_t state; // Current state of the generator.
+    uint64_t increment; // Odd step selecting the stream.
+};
+
+// Function to restart the generator at initState on the given stream.
+inline void Pcg32::seed(uint64_t initState, uint64_t stream)
+{
+    state = 0;
+    increment = (stream << 1) | 1;
+    next();
+    state += initState;
+    next();
+}
+
+// Function returning the next 32 random bits.
+inline uint32_t Pcg32::next()
+{
+    uint64_t old = state;
+    state = old * 6364136223846793005ULL + increment;
+    uint32_t shifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+    uint32_t rotation = (uint32_t)(old >> 59);
+    return (shifted >> rotation) | (shifted << ((-rotation) & 31));
+}
+
+// Function returning a uniformly distributed integer in [0, bound). Values that
+// would make the result biased towards small numbers are rejected.
+inline uint32_t Pcg32::nextBelow(uint32_t bound)
+{
+    uint32_t threshold = (0u - bound) % bound, r;
+
+    while ((r = next()) < threshold)
+        ;
+    return r % bound;
+}
+
+#endif
@@ -0,0 +1,78 @@
+// Headless replay of a game recorded with the --record option of the game.
+//
+// Build: g++ -O2 -std=c++17 replay.cpp -o replay -lpthread
+// Usage: replay <log file> [--repeat N] [--level <level file>]
+//
+// Plays the log through a World as fast as possible, N times, and prints the
+// time taken and whether the car ended where it did in the recorded game, as JSON.
+// A game played on a level file needs the same level file given with --level. A
+// streamed game is replayed on chunks generated from the seed of the log.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include "replay.h"
+
+// Main routine.
+int main(int argc, char** argv)
+{
+    int repeat = 1, n;
+    const char* levelPath = 0;
+    InputLog log;
+
+    for (n = 2; n + 1 < argc; n += 2)
+        if (!strcmp(argv[n], "--repeat"))
+            repeat = atoi(argv[n + 1]);
+        else if (!strcmp(argv[n], "--level"))
+            levelPath = argv[n + 1];
+        else
+            break;
+    if (argc < 2 || n != argc)
+    {
+        fprintf(stderr, "Usage: %s <log file> [--repeat N] [--level <level file>]\n", argv[0]);
+        return 1;
+    }
+    if (!log.load(argv[1]))
+    {
+        fprintf(stderr, "Failed to read input log: %s\n", argv[1]);
+        return 1;
+    }
+    if (log.getHeader().fromLevelFile && !levelPath)
+    {
+        fprintf(stderr, "The game was played on a level file, give it with --level\n");
+        return 1;
+    }
+
+    const InputLogHeader& header = log.getHeader();
+    CarState state = CarState();
+    uint32_t steps = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++)
+    {
+        World world;
+        std::unique_ptr<ChunkedWorld> chunks;
+        if (header.streamed)
+        {
+            chunks.reset(new ChunkedWorld(header.seed, header.layout));
+            world.setChunks(chunks.get());
+        }
+        if (levelPath && !world.loadLevel(levelPath))
+        {
+            fprintf(stderr, "Failed to load level file: %s\n", levelPath);
+            return 1;
+        }
+        steps = replayInputLog(log, world);
+        state = world.getState();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // The replay is exact, so the final state must match bit for bit.
+    int matches = !memcmp(&state, &header.finalState, sizeof(state));
+    printf("{\n  \"steps\": %u,\n  \"events\": %u,\n  \"repeat\": %d,\n  \"ms_per_replay\": %.3f,\n"
+        "  \"steps_per_sec\": %.0f,\n  \"final_x\": %g,\n  \"final_z\": %g,\n  \"final_angle\": %g,\n"
+        "  \"matches_recording\": %s\n}\n", steps, header.eventCount, repeat, seconds * 1e3 / repeat,
+        (double)steps * repeat / seconds, state.x, state.z, state.angle, matches ? "true" : "false");
+    return matches ? 0 : 2;
+}
@@ -0,0 +1,209 @@
+// Recording of the key events of a game into a compact binary log, and replay
+// of such a log through a headless World.
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "world.h"
+
+#define INPUT_LOG_MAGIC "CLOG" // First four bytes of an input log file.
+#define INPUT_LOG_VERSION 10 // Format version written by InputRecorder; 9 swept turning cars with the final heading.
+
+// Kinds of logged events. The low three bits of the kind byte hold the INPUT_*
+// value of key press and release events. Resets are not logged: the world
+// resets itself after a win or loss, in the replay as in the game.
+#define LOG_KEY_DOWN 0x10 // A driving key was pressed.
+#define LOG_KEY_UP 0x20 // A driving key was released.
+#define LOG_KEY 0x30 // An ASCII key was pressed, its code follows.
+
+// Header of an input log file. Followed by eventBytes bytes of events, each a
+// variable length count of the steps since the previous event, 7 bits per byte
+// with the high bit set on all bytes but the last, then the kind byte.
+struct InputLogHeader
+{
+    char magic[4]; // INPUT_LOG_MAGIC.
+    uint32_t version; // INPUT_LOG_VERSION.
+    uint64_t seed; // Seed of the world.
+    LayoutParams layout; // Parameters of every layout generated.
+    int32_t fromLevelFile; // Was the layout loaded from a level file instead?
+    int32_t streamed; // Was the game played on a ChunkedWorld instead?
+    uint32_t steps; // Steps simulated over the whole log.
+    uint32_t eventCount, eventBytes;
+    CarState finalState; // State of the car at the end, to check a replay against.
+};
+
+// Recorder of the events of one game. Time stamps are counted in simulation
+// steps rather than wall-clock time, so a replay repeats the game exactly.
+class InputRecorder
+{
+public:
+    InputRecorder();
+    void begin(uint64_t seed, const LayoutParams& layout, int fromLevelFile = 0, int streamed = 0);
+    void record(uint32_t step, int kind, int key = 0);
+    int save(const char* path, uint32_t steps, const CarState& finalState) const;
+    int getEventCount() const { return (int)header.eventCount; }
+
+private:
+    InputLogHeader header;
+    uint32_t lastStep; // Step of the last event recorded.
+    std::vector<unsigned char> events; // Encoded events.
+};
+
+// InputRecorder constructor.
+inline InputRecorder::InputRecorder()
+{
+    begin(0, makeLayoutParams(0, 0, 0));
+}
+
+// Function to start a new log of a game played with the given seed and layout
+// parameters, or on a level file if fromLevelFile is set, or on a ChunkedWorld
+// with the same seed and parameters if streamed is set.
+inline void InputRecorder::begin(uint64_t seed, const LayoutParams& layout, int fromLevelFile, int streamed)
+{
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INPUT_LOG_MAGIC, 4);
+    header.version = INPUT_LOG_VERSION;
+    header.seed = seed;
+    header.layout = layout;
+    header.fromLevelFile = fromLevelFile;
+    header.streamed = streamed;
+    lastStep = 0;
+    events.clear();
+}
+
+// Function to record an event of the given LOG_* kind before simulation step
+// step. For LOG_KEY_DOWN and LOG_KEY_UP key is the INPUT_* value, for LOG_KEY the
+// ASCII code.
+inline void InputRecorder::record(uint32_t step, int kind, int key)
+{
+    uint32_t delta = step - lastStep;
+
+    for (; delta >= 0x80; delta >>= 7)
+        events.push_back((unsigned char)(delta | 0x80));
+    events.push_back((unsigned char)delta);
+    if (kind == LOG_KEY)
+    {
+        events.push_back(LOG_KEY);
+        events.push_back((unsigned char)key);
+    }
+    else
+        events.push_back((unsigned char)(kind | (kind == LOG_KEY_DOWN || kind == LOG_KEY_UP ? key : 0)));
+    lastStep = step;
+    header.eventCount++;
+}
+
+// Function to write the log to path, with the number of steps simulated and the
+// final car state. Returns 1 on success and 0 on failure.
+inline int InputRecorder::save(const char* path, uint32_t steps, const CarState& finalState) const
+{
+    InputLogHeader out = header;
+    FILE* file = fopen(path, "wb");
+
+    if (!file)
+        return 0;
+    out.steps = steps;
+    out.eventBytes = (uint32_t)events.size();
+    out.finalState = finalState;
+    int ok = fwrite(&out, sizeof(out), 1, file) == 1 &&
+        (events.empty() || fwrite(events.data(), events.size(), 1, file) == 1);
+    return fclose(file) == 0 && ok;
+}
+
+// Input log read back from a file.
+class InputLog
+{
+public:
+    int load(const char* path);
+    const InputLogHeader& getHeader() const { return header; }
+    template <typename Visit>
+    void visitEvents(Visit visit) const;
+
+private:
+    InputLogHeader header;
+    std::vector<unsigned char> events; // Encoded events.
+};
+
+// Function to read the log at path. Returns 1 on success and 0 if the file cannot
+// be read or is not an input log of this version.
+inline int InputLog::load(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+
+    if (!file)
+        return 0;
+    int ok = fread(&header, sizeof(header), 1, file) == 1 && !memcmp(header.magic, INPUT_LOG_MAGIC, 4) &&
+        header.version == INPUT_LOG_VERSION;
+    if (ok)
+    {
+        events.resize(header.eventBytes);
+        ok = events.empty() || fread(events.data(), events.size(), 1, file) == 1;
+    }
+    fclose(file);
+    return ok;
+}
+
+// Function to call visit(step, kind, key) for each event in order, with the
+// arguments given to InputRecorder::record().
+template <typename Visit>
+void InputLog::visitEvents(Visit visit) const
+{
+    uint32_t step = 0;
+
+    for (size_t n = 0; n < events.size();)
+    {
+        uint32_t delta = 0;
+        for (int shift = 0; n < events.size(); shift += 7)
+        {
+            unsigned char byte = events[n++];
+            delta |= (uint32_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                break;
+        }
+        if (n >= events.size())
+            break; // Truncated event.
+        step += delta;
+
+        int kind = events[n] & 0xf0, key = events[n] & 0x0f;
+        n++;
+        if (kind == LOG_KEY)
+            key = n < events.size() ? events[n++] : 0;
+        visit(step, kind, key);
+    }
+}
+
+// Function to play log through world as fast as possible, the way the game ran
+// it: the world is seeded and given its layout, and before each step the events
+// logged for that step update the held keys. The world resets itself after a win
+// or loss as it did in the game. A game played on a level file is replayed on
+// the level world already has loaded, and a streamed game on the chunks world has
+// been given. Returns the number of steps run, which is the number logged.
+inline uint32_t replayInputLog(const InputLog& log, World& world)
+{
+    const InputLogHeader& header = log.getHeader();
+    HeldInputs held;
+    uint32_t step = 0;
+
+    world.seed(header.seed);
+    if (header.fromLevelFile || header.streamed)
+        world.reset();
+    else
+        world.generateLayout(header.layout);
+    log.visitEvents([&](uint32_t eventStep, int kind, int key)
+        {
+            for (; step < eventStep && step < header.steps; step++)
+                world.step(held.getControls());
+            if (kind == LOG_KEY_DOWN)
+                held.press(key);
+            else if (kind == LOG_KEY_UP)
+                held.release(key);
+        });
+    for (; step < header.steps; step++)
+        world.step(held.getControls());
+    return step;
+}
+
+#endif
@@ -0,0 +1,77 @@
+// Ring buffer of world snapshots for rewinding.
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <cstring>
+#include <vector>
+
+#include "world.h"
+
+// Fixed number of the most recent snapshots of a world, in one allocation. Pushing
+// into a full buffer overwrites the oldest snapshot, so pushing once per step
+// keeps the last capacity steps ready to rewind to without any allocation.
+class RewindBuffer
+{
+public:
+    explicit RewindBuffer(int capacity);
+    void clear() { size = 0; }
+    void push(const World& world);
+    int rewind(World& world, int steps);
+    int getSize() const { return size; }
+    int getCapacity() const { return capacity; }
+
+private:
+    int capacity; // Number of slots.
+    int slotSize; // Bytes per snapshot, set by the first push() after clear().
+    int next; // Slot the next push() writes.
+    int size; // Number of snapshots held.
+    std::vector<unsigned char> slots;
+};
+
+// RewindBuffer constructor.
+inline RewindBuffer::RewindBuffer(int capacity) : capacity(capacity)
+{
+    slotSize = 0;
+    next = 0;
+    size = 0;
+}
+
+// Function to save a snapshot of world as the most recent one. The snapshot size
+// only changes with the layout, so the slots are only reallocated then, and the
+// snapshots of the old layout are dropped.
+inline void RewindBuffer::push(const World& world)
+{
+    if (world.getSnapshotSize() != slotSize)
+    {
+        slotSize = world.getSnapshotSize();
+        slots.assign((size_t)capacity * slotSize, 0);
+        size = 0;
+    }
+    if (capacity == 0)
+        return;
+    world.saveSnapshot(&slots[(size_t)next * slotSize]);
+    next = (next + 1) % capacity;
+    if (size < capacity)
+        size++;
+}
+
+// Function to restore world to the snapshot pushed steps pushes ago, 1 being the
+// most recent, and drop it and the snapshots pushed after it. Rewinds as far as
+// possible if fewer are held. Returns the number of pushes rewound, or 0 if there
+// is nothing to rewind to or the snapshots belong to another layout.
+inline int RewindBuffer::rewind(World& world, int steps)
+{
+    if (steps > size)
+        steps = size;
+    if (steps <= 0)
+        return 0;
+
+    int slot = ((next - steps) % capacity + capacity) % capacity;
+    if (!world.loadSnapshot(&slots[(size_t)slot * slotSize]))
+        return 0;
+    next = slot;
+    size -= steps;
+    return steps;
+}
+
+#endif
@@ -0,0 +1,118 @@
+// Rewind regression test. Runs headless, no window is opened.
+//
+// Build: g++ -O2 -std=c++17 rewind_test.cpp -o rewind_test -lpthread
+// Usage: rewind_test [--steps N] [--capacity N] [--seed S]
+//
+// Drives a World with random inputs through generated layouts, pushing it into a
+// RewindBuffer before every step, and now and then rewinds a random number of
+// steps and steps on again from there with the same inputs. Every step must
+// leave the world just as a fresh world given the inputs without any rewinds:
+// same events, and the same snapshot, which holds the car state, the generator
+// of the next layout and the reached flags. A rewind within the current layout
+// must go back as far as asked while the buffer holds that many steps. Prints
+// the mismatches found and returns 1 if there are any.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "rewind.h"
+
+#define REWIND_CHANCE 50 // One step in this many is followed by a rewind.
+#define HOLD_STEPS 10 // Longest run of steps an input is held for.
+
+// Function to set up world the same way for both runs.
+static void startWorld(World& world, int seed)
+{
+    world.seed(seed);
+    world.generateLayout(makeLayoutParams(8, 6, 100));
+}
+
+// Main routine.
+int main(int argc, char** argv)
+{
+    int steps = 20000, capacity = 32, seed = 1;
+
+    for (int n = 1; n < argc; n++)
+        if (!strcmp(argv[n], "--steps") && n + 1 < argc)
+            steps = atoi(argv[++n]);
+        else if (!strcmp(argv[n], "--capacity") && n + 1 < argc)
+            capacity = atoi(argv[++n]);
+        else if (!strcmp(argv[n], "--seed") && n + 1 < argc)
+            seed = atoi(argv[++n]);
+        else
+        {
+            fprintf(stderr, "Usage: %s [--steps N] [--capacity N] [--seed S]\n", argv[0]);
+            return 1;
+        }
+
+    // Inputs held for a few steps each, mostly forward so the car gets around.
+    static const int choices[8] = { INPUT_FORWARD, INPUT_FORWARD, INPUT_FORWARD, INPUT_TURN_LEFT,
+        INPUT_TURN_RIGHT, INPUT_BACKWARD, INPUT_BRAKE, INPUT_NONE };
+    Pcg32 random(seed, 1);
+    std::vector<int> inputs(steps);
+    for (int i = 0; i < steps; )
+    {
+        int input = choices[random.nextBelow(8)], hold = 1 + (int)random.nextBelow(HOLD_STEPS);
+        for (; hold > 0 && i < steps; hold--)
+            inputs[i++] = input;
+    }
+
+    // Reference run: snapshot k is the world after k steps.
+    World reference;
+    startWorld(reference, seed);
+    int snapshotSize = reference.getSnapshotSize(), resets = 0;
+    std::vector<std::vector<unsigned char> > expected(steps + 1);
+    std::vector<int> expectedEvents(steps);
+    expected[0].resize(snapshotSize);
+    reference.saveSnapshot(expected[0].data());
+    for (int i = 0; i < steps; i++)
+    {
+        expectedEvents[i] = reference.step(inputs[i]);
+        resets += (expectedEvents[i] & EVENT_RESET) != 0;
+        expected[i + 1].resize(reference.getSnapshotSize());
+        reference.saveSnapshot(expected[i + 1].data());
+    }
+
+    // Rewinding run. held counts the snapshots in the buffer taken in the current layout.
+    World world;
+    RewindBuffer buffer(capacity);
+    std::vector<unsigned char> snapshot;
+    int i = 0, held = 0, rewinds = 0, rewound = 0, stepMisses = 0, rewindMisses = 0;
+    startWorld(world, seed);
+    while (i < steps)
+    {
+        buffer.push(world);
+        held = held < capacity ? held + 1 : capacity;
+        int events = world.step(inputs[i]);
+        if (events & EVENT_RESET)
+            held = 0;
+        i++;
+        snapshot.resize(world.getSnapshotSize());
+        world.saveSnapshot(snapshot.data());
+        stepMisses += events != expectedEvents[i - 1] || snapshot != expected[i];
+
+        if (random.nextBelow(REWIND_CHANCE) == 0)
+        {
+            int asked = 1 + (int)random.nextBelow(capacity + 8);
+            int done = buffer.rewind(world, asked);
+            rewindMisses += done > asked || (asked <= held && done != asked);
+            if (done > 0)
+            {
+                i -= done;
+                held -= done;
+                rewinds++;
+                rewound += done;
+                snapshot.resize(world.getSnapshotSize());
+                world.saveSnapshot(snapshot.data());
+                rewindMisses += snapshot != expected[i];
+            }
+        }
+    }
+
+    printf("%d steps, %d resets, %d rewinds of %d steps in all, %d step and %d rewind mismatches\n", steps, resets,
+        rewinds, rewound, stepMisses, rewindMisses);
+    int failures = stepMisses + rewindMisses;
+    printf(failures ? "FAILED\n" : "passed\n");
+    return failures != 0;
+}
@@ -0,0 +1,246 @@
+// Signed distance field of the cube layout on the ground plane.
+#ifndef SDF_H
+#define SDF_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "collision.h"
+#include "parallel.h"
+
+#define SDF_MAX_TEXELS 67108864 // Layouts needing a larger field are not given one.
+
+// Function computing the squared distance transform of the n samples f, spaced
+// one unit apart, into d: d[q] = min over p of (q - p)^2 + f[p]. v and boundary
+// are scratch arrays of n and n + 1 elements. This is the lower envelope of
+// parabolas method of Felzenszwalb and Huttenlocher, linear in n.
+inline void distanceTransform1D(const double* f, int n, double* d, int* v, double* boundary)
+{
+    int k = 0;
+
+    v[0] = 0;
+    boundary[0] = -1.0e30;
+    boundary[1] = 1.0e30;
+    for (int q = 1; q < n; q++)
+    {
+        double s = ((f[q] + (double)q * q) - (f[v[k]] + (double)v[k] * v[k])) / (2.0 * q - 2.0 * v[k]);
+        while (s <= boundary[k])
+        {
+            k--;
+            s = ((f[q] + (double)q * q) - (f[v[k]] + (double)v[k] * v[k])) / (2.0 * q - 2.0 * v[k]);
+        }
+        k++;
+        v[k] = q;
+        boundary[k] = s;
+        boundary[k + 1] = 1.0e30;
+    }
+    k = 0;
+    for (int q = 0; q < n; q++)
+    {
+        while (boundary[k + 1] < q)
+            k++;
+        d[q] = (double)(q - v[k]) * (q - v[k]) + f[v[k]];
+    }
+}
+
+// Signed distance field of a CubeStore sampled at the centers of square texels.
+// Values are distances on the ground plane to the nearest cube, negative inside
+// a cube, and are lowered so that clearance() never overestimates the true
+// distance. Outside the baked area the field is clamped, which stays
+// conservative because every cube lies inside it.
+class DistanceField
+{
+public:
+    DistanceField();
+    void bake(const CubeStore& store, float size, float margin, int threads);
+    float clearance(float x, float z) const;
+    int getWidth() const { return width; }
+    int getDepth() const { return depth; }
+    void write(BlockWriter& out) const;
+    int read(BlockReader& in);
+
+private:
+    void transform(float* grid, int threads) const;
+
+    float originX, originZ, cellSize;
+    int width, depth; // Texels along x and z.
+    MappedArray<float> distance; // depth rows of width texels.
+};
+
+// DistanceField default constructor.
+inline DistanceField::DistanceField()
+{
+    originX = 0.0;
+    originZ = 0.0;
+    cellSize = 1.0;
+    width = 0; // Indicates no field has been baked.
+    depth = 0;
+}
+
+// Function to run the 2D squared distance transform on the width x depth texels
+// of grid in place: first along every column, then along every row, each pass
+// split across threads. The grid holds floats to keep a large bake small; each
+// line is transformed in double precision in a buffer of its thread.
+inline void DistanceField::transform(float* grid, int threads) const
+{
+    parallelFor(width, threads, [&](int begin, int end)
+        {
+            std::vector<double> f(depth), d(depth), boundary(depth + 1);
+            std::vector<int> v(depth);
+            for (int i = begin; i < end; i++)
+            {
+                for (int j = 0; j < depth; j++)
+                    f[j] = grid[(size_t)j * width + i];
+                distanceTransform1D(f.data(), depth, d.data(), v.data(), boundary.data());
+                for (int j = 0; j < depth; j++)
+                    grid[(size_t)j * width + i] = (float)d[j];
+            }
+        });
+    parallelFor(depth, threads, [&](int begin, int end)
+        {
+            std::vector<double> f(width), d(width), boundary(width + 1);
+            std::vector<int> v(width);
+            for (int j = begin; j < end; j++)
+            {
+                float* row = &grid[(size_t)j * width];
+                std::copy(row, row + width, f.begin());
+                distanceTransform1D(f.data(), width, d.data(), v.data(), boundary.data());
+                for (int i = 0; i < width; i++)
+                    row[i] = (float)d[i];
+            }
+        });
+}
+
+// Function to bake the field of the cubes in store with texels of edge length
+// size, covering the cubes plus margin on every side, using threads threads.
+// margin should be at least one texel. Nothing is baked if the field would need
+// more than SDF_MAX_TEXELS texels.
+inline void DistanceField::bake(const CubeStore& store, float size, float margin, int threads)
+{
+    const float* cx = store.getX(), * cz = store.getZ(), * cr = store.getR();
+    float minX = 1.0e30f, minZ = 1.0e30f, maxX = -1.0e30f, maxZ = -1.0e30f;
+    int k;
+
+    distance.clear();
+    width = depth = 0;
+    if (store.getCount() == 0)
+        return;
+    for (k = 0; k < store.getCount(); k++)
+    {
+        minX = std::min(minX, cx[k] - cr[k]);
+        minZ = std::min(minZ, cz[k] - cr[k]);
+        maxX = std::max(maxX, cx[k] + cr[k]);
+        maxZ = std::max(maxZ, cz[k] + cr[k]);
+    }
+    cellSize = size;
+    originX = minX - margin;
+    originZ = minZ - margin;
+    double texels = (std::ceil((maxX - minX + 2 * margin) / size) + 1) * (std::ceil((maxZ - minZ + 2 * margin) / size) + 1);
+    if (texels > SDF_MAX_TEXELS)
+        return;
+    width = (int)std::ceil((maxX - minX + 2 * margin) / size) + 1;
+    depth = (int)std::ceil((maxZ - minZ + 2 * margin) / size) + 1;
+
+    // Rasterize the cubes: a texel is inside if its center is. The texel holding
+    // the center of a cube is inside too, so a cube smaller than a texel, which
+    // may contain no texel center, is not missing from the field.
+    std::vector<unsigned char> inside((size_t)width * depth, 0);
+    for (k = 0; k < store.getCount(); k++)
+    {
+        int i0 = std::max(0, (int)std::ceil((cx[k] - cr[k] - originX) / cellSize - 0.5f));
+        int i1 = std::min(width - 1, (int)std::floor((cx[k] + cr[k] - originX) / cellSize - 0.5f));
+        int j0 = std::max(0, (int)std::ceil((cz[k] - cr[k] - originZ) / cellSize - 0.5f));
+        int j1 = std::min(depth - 1, (int)std::floor((cz[k] + cr[k] - originZ) / cellSize - 0.5f));
+        for (int j = j0; j <= j1; j++)
+            for (int i = i0; i <= i1; i++)
+                inside[(size_t)j * width + i] = 1;
+        int i = std::min(std::max((int)std::floor((cx[k] - originX) / cellSize), 0), width - 1);
+        int j = std::min(std::max((int)std::floor((cz[k] - originZ) / cellSize), 0), depth - 1);
+        inside[(size_t)j * width + i] = 1;
+    }
+
+    // Distance from outside texels to the cubes, transformed in the field itself,
+    // and from inside texels to free space. This needs 9 bytes a texel at most,
+    // about 600 MB at SDF_MAX_TEXELS. Floats round the squared distances to 24
+    // bits, far under a texel once the square root is taken.
+    distance.resize((size_t)width * depth);
+    float* field = distance.data();
+    std::vector<float> insideGrid((size_t)width * depth);
+    for (size_t t = 0; t < inside.size(); t++)
+    {
+        field[t] = inside[t] ? 0.0f : 1.0e20f;
+        insideGrid[t] = inside[t] ? 1.0e20f : 0.0f;
+    }
+    std::vector<unsigned char>().swap(inside);
+    transform(field, threads);
+    transform(insideGrid.data(), threads);
+
+    // Every point of a cube is less than a texel along each axis from the center
+    // of an inside texel, so lower the distances by a texel diagonal to keep them
+    // from overestimating.
+    float slack = std::sqrt(2.0f) * cellSize;
+    parallelFor(depth, threads, [&](int begin, int end)
+        {
+            for (size_t t = (size_t)begin * width; t < (size_t)end * width; t++)
+                field[t] = (std::sqrt(field[t]) - std::sqrt(insideGrid[t])) * cellSize - slack;
+        });
+}
+
+// Function to write the field to out.
+inline void DistanceField::write(BlockWriter& out) const
+{
+    float params[3] = { originX, originZ, cellSize };
+    int size[2] = { width, depth };
+
+    out.array(params, 3);
+    out.array(size, 2);
+    out.array(distance.data(), distance.size());
+}
+
+// Function to read a field written by write() from in. Returns 1 on success and
+// 0 if the blocks do not hold a distance field.
+inline int DistanceField::read(BlockReader& in)
+{
+    MappedArray<float> paramsRead, texels;
+    MappedArray<int> sizeRead;
+
+    if (!in.array(paramsRead) || !in.array(sizeRead) || !in.array(texels) || paramsRead.size() != 3 ||
+        sizeRead.size() != 2)
+        return 0;
+    const float* params = paramsRead.begin();
+    const int* size = sizeRead.begin();
+    if (((size[0] != 0 || size[1] != 0) && (size[0] < 2 || size[1] < 2)) ||
+        texels.size() != (size_t)size[0] * size[1] || !std::isfinite(params[0]) || !std::isfinite(params[1]) ||
+        !(params[2] > 0))
+        return 0;
+    originX = params[0];
+    originZ = params[1];
+    cellSize = params[2];
+    width = size[0];
+    depth = size[1];
+    distance = std::move(texels);
+    return 1;
+}
+
+// Function returning a lower bound on the distance from (x, z) to the nearest
+// cube, negative inside a cube, by bilinear interpolation between the four
+// nearest texels. Distance changes at most one unit per unit moved, so the
+// interpolated value is lowered by the largest distance to those texels.
+inline float DistanceField::clearance(float x, float z) const
+{
+    if (width == 0)
+        return 1.0e30f; // Nothing baked, nothing to hit.
+
+    float u = (x - originX) / cellSize - 0.5f, v = (z - originZ) / cellSize - 0.5f;
+    u = std::min(std::max(u, 0.0f), (float)(width - 1));
+    v = std::min(std::max(v, 0.0f), (float)(depth - 1));
+    int i = std::min((int)u, width - 2 < 0 ? 0 : width - 2), j = std::min((int)v, depth - 2 < 0 ? 0 : depth - 2);
+    int i1 = std::min(i + 1, width - 1), j1 = std::min(j + 1, depth - 1);
+    float fu = u - i, fv = v - j;
+    const float* row0 = &distance[(size_t)j * width], * row1 = &distance[(size_t)j1 * width];
+    float value = (row0[i] * (1 - fu) + row0[i1] * fu) * (1 - fv) + (row1[i] * (1 - fu) + row1[i1] * fu) * fv;
+    return value - std::sqrt(2.0f) * cellSize;
+}
+
+#endif
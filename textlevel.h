@@ -0,0 +1,575 @@
+// Text levels written by hand: cubes and trigger areas listed one by one in CSV
+// or JSON, read as a stream straight into an obstacle field.
+//
+// CSV: one object per line, blank lines and lines starting with # skipped.
+//     cube,x,z[,size[,red,green,blue]]
+//     goal,x,z[,radius]  (also checkpoint and hazard)
+// JSON: an object with arrays of cube and trigger objects; other members of the
+// top-level object, such as a name, are skipped.
+//     { "cubes": [ { "x": 0, "z": -40, "size": 6, "color": [255, 0, 0] }, ... ],
+//       "triggers": [ { "type": "goal", "x": 3, "z": -95, "radius": 10 }, ... ] }
+// A color can also be given as "#rrggbb". Sizes are edge lengths; cubes are 2 *
+// CUBE_RADIUS wide and white, and triggers TEXT_LEVEL_TRIGGER_RADIUS wide,
+// unless given.
+#ifndef TEXTLEVEL_H
+#define TEXTLEVEL_H
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "obstacles.h"
+
+#define TEXT_LEVEL_BUFFER 65536 // Bytes read from a text level at a time.
+#define TEXT_LEVEL_TOKEN 64 // Longest number, name or string in a text level, with its terminator.
+#define TEXT_LEVEL_TRIGGER_RADIUS 10.0f // Radius of a trigger area that does not give one.
+
+// Tokens of a JSON text, returned by JsonReader::next(). Punctuation is returned
+// as its own character.
+#define JSON_END 0 // End of the text.
+#define JSON_ERROR 1 // Malformed text; see JsonReader::getText().
+#define JSON_STRING 2 // A string, its contents in getText().
+#define JSON_NUMBER 3 // A number, its value in getNumber().
+#define JSON_LITERAL 4 // true, false or null, spelled out in getText().
+
+// Function to parse the whole of text as a finite number into value. Whole
+// numbers, the most common in levels, are parsed here rather than by the much
+// slower strtod(). Returns 1 on success and 0 otherwise.
+inline int parseTextNumber(const char* text, double& value)
+{
+    const char* c = text + (*text == '-');
+    long long whole = 0;
+    int digits = 0;
+
+    for (; *c >= '0' && *c <= '9' && digits < 15; c++, digits++)
+        whole = whole * 10 + (*c - '0');
+    if (*c == '\0' && digits > 0)
+    {
+        value = *text == '-' ? -(double)whole : (double)whole;
+        return 1;
+    }
+
+    char* end;
+    value = strtod(text, &end);
+    return end != text && *end == '\0' && std::isfinite(value);
+}
+
+// File read through a fixed buffer one character at a time, counting lines, so
+// texts of any size are read in constant memory.
+class TextSource
+{
+public:
+    TextSource(FILE* file) : file(file), length(0), position(0), line(1) {}
+    int peek() { return position < length || fill() ? buffer[position] : EOF; }
+    int get();
+    int getLine() const { return line; }
+
+private:
+    int fill();
+
+    FILE* file;
+    unsigned char buffer[TEXT_LEVEL_BUFFER];
+    size_t length, position; // Bytes in buffer and bytes of them read.
+    int line; // Line of the next character.
+};
+
+// Function returning the next character, or EOF at the end of the file.
+inline int TextSource::get()
+{
+    int c = peek();
+    if (c == '\n')
+        line++;
+    if (c != EOF)
+        position++;
+    return c;
+}
+
+// Function to read the next part of the file into the buffer. Returns 1 if any
+// bytes were read and 0 at the end of the file.
+inline int TextSource::fill()
+{
+    length = fread(buffer, 1, sizeof(buffer), file);
+    position = 0;
+    return length > 0;
+}
+
+// Pull tokenizer of JSON text. It keeps only the current token, never a tree of
+// the whole text, so the reader of a level turns each object into cubes as soon
+// as it is complete.
+class JsonReader
+{
+public:
+    JsonReader(TextSource& source) : source(source), number(0.0) { text[0] = '\0'; }
+    int next();
+    int skipValue(int token);
+    const char* getText() const { return text; }
+    double getNumber() const { return number; }
+
+private:
+    int fail(const char* message);
+    int readString();
+    int readWord();
+
+    TextSource& source;
+    char text[TEXT_LEVEL_TOKEN]; // Contents of the current string or word, or the error.
+    double number; // Value of the current number.
+};
+
+// Function to set the error message and return JSON_ERROR.
+inline int JsonReader::fail(const char* message)
+{
+    snprintf(text, sizeof(text), "%s", message);
+    return JSON_ERROR;
+}
+
+// Function returning the next token: one of the JSON_* values or one of the
+// characters { } [ ] : and ,.
+inline int JsonReader::next()
+{
+    int c;
+
+    while ((c = source.peek()) == ' ' || c == '\t' || c == '\r' || c == '\n')
+        source.get();
+    switch (c)
+    {
+    case EOF:
+        return JSON_END;
+    case '{': case '}': case '[': case ']': case ':': case ',':
+        return source.get();
+    case '"':
+        source.get();
+        return readString();
+    default:
+        return readWord();
+    }
+}
+
+// Function to read the rest of a string whose opening quote has been read.
+inline int JsonReader::readString()
+{
+    size_t n = 0;
+
+    for (;;)
+    {
+        int c = source.get();
+        if (c == EOF || c == '\n')
+            return fail("unterminated string");
+        if (c == '"')
+            break;
+        if (c == '\\')
+        {
+            switch (c = source.get())
+            {
+            case '"': case '\\': case '/': break;
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            default: return fail("unsupported escape in string");
+            }
+        }
+        if (n + 1 >= sizeof(text))
+            return fail("string too long");
+        text[n++] = (char)c;
+    }
+    text[n] = '\0';
+    return JSON_STRING;
+}
+
+// Function to read a number or a literal.
+inline int JsonReader::readWord()
+{
+    size_t n = 0;
+    int c;
+
+    while ((c = source.peek()) != EOF && (isalnum(c) || c == '-' || c == '+' || c == '.'))
+    {
+        if (n + 1 >= sizeof(text))
+            return fail("number too long");
+        text[n++] = (char)source.get();
+    }
+    text[n] = '\0';
+    if (n == 0)
+        return fail("unexpected character");
+    if (!strcmp(text, "true") || !strcmp(text, "false") || !strcmp(text, "null"))
+        return JSON_LITERAL;
+
+    if (!parseTextNumber(text, number))
+        return fail("malformed number");
+    return JSON_NUMBER;
+}
+
+// Function to skip the value that starts with token, which has been read, with
+// everything nested in it. Returns 1 on success and 0 on malformed text.
+inline int JsonReader::skipValue(int token)
+{
+    int depth = 0;
+
+    for (;;)
+    {
+        if (token == '{' || token == '[')
+            depth++;
+        else if (token == '}' || token == ']')
+            depth--;
+        else if (token == JSON_END || token == JSON_ERROR || ((token == ':' || token == ',') && depth == 0))
+            return 0;
+        if (depth < 0)
+            return 0;
+        if (depth == 0)
+            return 1;
+        token = next();
+    }
+}
+
+// One cube or trigger area of a text level, as read.
+struct TextLevelObject
+{
+    int isCube; // A cube rather than a trigger area?
+    int type; // TRIGGER_* value of a trigger area.
+    float x, z; // Center on the ground.
+    float size; // Edge length of a cube or diameter of a trigger area.
+    unsigned char color[3]; // Color of a cube.
+};
+
+// Function returning an object of kind name with the default size and color,
+// setting ok to 0 if name is not cube, goal, checkpoint or hazard.
+inline TextLevelObject makeTextLevelObject(const char* name, int& ok)
+{
+    TextLevelObject object;
+    object.isCube = !strcmp(name, "cube");
+    object.type = !strcmp(name, "goal") ? TRIGGER_GOAL : !strcmp(name, "checkpoint") ? TRIGGER_CHECKPOINT :
+        !strcmp(name, "hazard") ? TRIGGER_HAZARD : -1;
+    object.x = object.z = 0.0;
+    object.size = object.isCube ? 2 * CUBE_RADIUS : 2 * TEXT_LEVEL_TRIGGER_RADIUS;
+    object.color[0] = object.color[1] = object.color[2] = 255;
+    ok = object.isCube || object.type >= 0;
+    return object;
+}
+
+// Function to add object to field. Returns 1 on success and 0 if its size is not
+// positive or its center is not finite. Cubes of any positive size are kept by
+// the distance field, also those smaller than one of its texels.
+inline int addTextLevelObject(ObstacleField& field, const TextLevelObject& object)
+{
+    if (!std::isfinite(object.x) || !std::isfinite(object.z) || !(object.size > 0) || !std::isfinite(object.size))
+        return 0;
+    if (object.isCube)
+        field.cubes.add(object.x, 0.0, object.z, object.size / 2, object.color[0], object.color[1], object.color[2]);
+    else
+        field.triggers.add(object.x, object.z, object.size / 2, object.type);
+    return 1;
+}
+
+// Function to parse a color component from text into component. Returns 1 on
+// success and 0 if text is not a whole number from 0 to 255.
+inline int parseColorComponent(const char* text, unsigned char& component)
+{
+    double value;
+
+    if (!parseTextNumber(text, value) || value != floor(value) || value < 0 || value > 255)
+        return 0;
+    component = (unsigned char)value;
+    return 1;
+}
+
+// Function to parse a "#rrggbb" color from text into color. Returns 1 on success
+// and 0 otherwise.
+inline int parseHexColor(const char* text, unsigned char* color)
+{
+    int digits[6];
+
+    if (text[0] != '#' || strlen(text) != 7)
+        return 0;
+    for (int k = 0; k < 6; k++)
+    {
+        int c = text[k + 1];
+        digits[k] = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 :
+            c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digits[k] < 0)
+            return 0;
+    }
+    for (int k = 0; k < 3; k++)
+        color[k] = (unsigned char)(16 * digits[2 * k] + digits[2 * k + 1]);
+    return 1;
+}
+
+// Function to read the CSV level in source into field. Returns 1 on success and
+// 0 on the first malformed line, setting error to what is wrong with it.
+inline int readCsvLevel(TextSource& source, ObstacleField& field, std::string& error)
+{
+    char fields[7][TEXT_LEVEL_TOKEN];
+    int c;
+
+    while ((c = source.peek()) != EOF)
+    {
+        // Split the next line into its comma separated fields.
+        int line = source.getLine(), count = 0, fits = 1, ok;
+        size_t n = 0;
+        while ((c = source.get()) != EOF && c != '\n')
+        {
+            if (c == ',')
+            {
+                if (count < 7)
+                    fields[count][n] = '\0';
+                count++;
+                n = 0;
+            }
+            else if (c == ' ' || c == '\t' || c == '\r')
+                continue;
+            else if (count >= 7 || n + 1 >= TEXT_LEVEL_TOKEN)
+                fits = 0;
+            else
+                fields[count][n++] = (char)c;
+        }
+        if (count < 7)
+            fields[count][n] = '\0';
+        count++;
+        if (fields[0][0] == '#' || (count == 1 && fields[0][0] == '\0'))
+            continue; // Comment or blank line.
+
+        TextLevelObject object = makeTextLevelObject(fields[0], ok);
+        double x = 0.0, z = 0.0, size = 0.0;
+        if (ok && fits && count >= 3 && count <= (object.isCube ? 7 : 4) && count != 5 && count != 6)
+        {
+            ok = parseTextNumber(fields[1], x) && parseTextNumber(fields[2], z);
+            object.x = (float)x;
+            object.z = (float)z;
+            if (ok && count >= 4)
+            {
+                ok = parseTextNumber(fields[3], size);
+                object.size = (float)(object.isCube ? size : 2 * size);
+            }
+            for (int k = 0; ok && k < 3 && count == 7; k++)
+                ok = parseColorComponent(fields[4 + k], object.color[k]);
+            ok = ok && addTextLevelObject(field, object);
+        }
+        else
+            ok = 0;
+        if (!ok)
+        {
+            error = "line " + std::to_string(line) +
+                ": expected cube,x,z[,size[,red,green,blue]] or goal|checkpoint|hazard,x,z[,radius]";
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Function to read the members of the JSON object after the opening brace, which
+// has been read, into object. Returns 0 with error set on malformed text.
+inline int readJsonObject(JsonReader& json, TextLevelObject& object, std::string& error)
+{
+    int token = json.next();
+
+    if (token == '}')
+        return 1;
+    for (;;)
+    {
+        if (token != JSON_STRING)
+        {
+            error = "expected a member name";
+            return 0;
+        }
+        std::string name = json.getText();
+        if (json.next() != ':')
+        {
+            error = "expected : after \"" + name + "\"";
+            return 0;
+        }
+        token = json.next();
+
+        int ok = token == JSON_NUMBER;
+        if (name == "x" && ok)
+            object.x = (float)json.getNumber();
+        else if (name == "z" && ok)
+            object.z = (float)json.getNumber();
+        else if (name == "size" && object.isCube && ok)
+            object.size = (float)json.getNumber();
+        else if (name == "radius" && !object.isCube && ok)
+            object.size = 2 * (float)json.getNumber();
+        else if (name == "type" && !object.isCube && token == JSON_STRING)
+        {
+            TextLevelObject typed = makeTextLevelObject(json.getText(), ok);
+            ok = ok && !typed.isCube;
+            object.type = typed.type;
+        }
+        else if (name == "color" && object.isCube && token == JSON_STRING)
+            ok = parseHexColor(json.getText(), object.color);
+        else if (name == "color" && object.isCube && token == '[')
+        {
+            ok = 1;
+            for (int k = 0; ok && k < 3; k++)
+            {
+                double value = 0.0;
+                ok = (k == 0 || json.next() == ',') && json.next() == JSON_NUMBER;
+                if (ok)
+                    value = json.getNumber();
+                ok = ok && value == floor(value) && value >= 0 && value <= 255;
+                object.color[k] = (unsigned char)value;
+            }
+            ok = ok && json.next() == ']';
+        }
+        else
+            ok = 0;
+        if (!ok)
+        {
+            int known = name == "x" || name == "z" || name == (object.isCube ? "size" : "radius") ||
+                name == (object.isCube ? "color" : "type");
+            error = token == JSON_ERROR ? std::string(json.getText()) :
+                (known ? "invalid value of \"" : "unknown member \"") + name + "\"";
+            return 0;
+        }
+
+        token = json.next();
+        if (token == '}')
+            return 1;
+        if (token != ',')
+        {
+            error = "expected , or } after \"" + name + "\"";
+            return 0;
+        }
+        token = json.next();
+    }
+}
+
+// Function to read the JSON array of cubes, if isCube is set, or of trigger areas
+// after the opening bracket, which has been read, into field. Trigger areas are
+// goals unless they give a type. Returns 0 with error set on malformed text.
+inline int readJsonArray(JsonReader& json, int isCube, ObstacleField& field, std::string& error)
+{
+    const char* kind = isCube ? "cube" : "trigger";
+    int token = json.next(), ok;
+
+    if (token == ']')
+        return 1;
+    for (;;)
+    {
+        TextLevelObject object = makeTextLevelObject(isCube ? "cube" : "goal", ok);
+        if (token != '{')
+        {
+            error = std::string("expected a ") + kind + " object";
+            return 0;
+        }
+        if (!readJsonObject(json, object, error))
+            return 0;
+        if (!addTextLevelObject(field, object))
+        {
+            error = std::string("invalid ") + kind + ": its size must be positive";
+            return 0;
+        }
+        token = json.next();
+        if (token == ']')
+            return 1;
+        if (token != ',')
+        {
+            error = "expected , or ] in array";
+            return 0;
+        }
+        token = json.next();
+    }
+}
+
+// Function to read the JSON level in source into field. Returns 1 on success and
+// 0 on malformed text, setting error to what is wrong and on which line.
+inline int readJsonLevel(TextSource& source, ObstacleField& field, std::string& error)
+{
+    JsonReader json(source);
+    int token = json.next(), ok = 0;
+
+    if (token != '{')
+        error = "expected a level object";
+    else if ((token = json.next()) == '}')
+        ok = 1;
+    else
+        for (;;)
+        {
+            if (token != JSON_STRING)
+            {
+                error = "expected a member name";
+                break;
+            }
+            std::string name = json.getText();
+            if (json.next() != ':')
+            {
+                error = "expected : after \"" + name + "\"";
+                break;
+            }
+            token = json.next();
+            if (name == "cubes" || name == "triggers")
+            {
+                if (token != '[')
+                {
+                    error = "expected an array of " + name;
+                    break;
+                }
+                if (!readJsonArray(json, name == "cubes", field, error))
+                    break;
+            }
+            else if (!json.skipValue(token))
+            {
+                error = "malformed value of \"" + name + "\"";
+                break;
+            }
+
+            token = json.next();
+            if (token == '}')
+            {
+                ok = 1;
+                break;
+            }
+            if (token != ',')
+            {
+                error = "expected , or } after \"" + name + "\"";
+                break;
+            }
+            token = json.next();
+        }
+    if (ok && json.next() != JSON_END)
+    {
+        ok = 0;
+        error = "unexpected text after the level object";
+    }
+    if (!ok)
+        error = "line " + std::to_string(source.getLine()) + ": " + error;
+    return ok;
+}
+
+// Function to read the text level at path into field, in place of its cubes and
+// triggers. The file is JSON if it starts with {, after any white space, and CSV
+// otherwise. build() must be called afterwards. Returns 1 on success and 0 if
+// the file cannot be read or is malformed, setting error to why.
+inline int readTextLevel(const char* path, ObstacleField& field, std::string& error)
+{
+    FILE* file = fopen(path, "rb");
+    int c, ok;
+
+    if (!file)
+    {
+        error = "cannot open file";
+        return 0;
+    }
+    std::unique_ptr<TextSource> source(new TextSource(file)); // Too large for the stack with its buffer.
+    while ((c = source->peek()) == ' ' || c == '\t' || c == '\r' || c == '\n')
+        source->get();
+
+    field.cubes.clear();
+    field.triggers.clear();
+    if (c == '{')
+        ok = readJsonLevel(*source, field, error);
+    else
+        ok = readCsvLevel(*source, field, error);
+    if (ok && ferror(file))
+    {
+        ok = 0;
+        error = "read error";
+    }
+    fclose(file);
+    return ok;
+}
+
+#endif
@@ -0,0 +1,142 @@
+// Text level test. Runs headless, no window is opened.
+//
+// Build: g++ -O2 -std=c++17 textlevel_test.cpp -o textlevel_test -lpthread
+// Usage: textlevel_test [--poses N] [--seed S] [--prefix P]
+//
+// Writes CSV and JSON text levels of cubes smaller than a texel of the distance
+// field, off the grid, to P.csv and P.json, reads them the way the game and
+// level_tool compile do, and compiles them to the level file P.clvl. Random poses
+// over each level, and the car placed on every cube, must give the same answer
+// from cubeCarCollision() as a brute-force checkBoxCubeIntersection() over every
+// cube, with the distance field baked, without it, and from the level file.
+// Prints the mismatches found, removes the files and returns 1 if there are any.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "level.h"
+#include "textlevel.h"
+
+#define TINY_CUBES 30 // Cubes of the larger levels.
+#define TINY_EXTENT 40.0f // Half the width and depth of the area they are in.
+
+// Function to check the car in pose against every cube of cubes.
+static int bruteForceCollision(const CubeStore& cubes, const CarPose& pose)
+{
+    for (int k = 0; k < cubes.getCount(); k++)
+        if (checkBoxCubeIntersection(pose.x, pose.z, -pose.headingZ, -pose.headingX, CAR_HALF_WIDTH,
+            CAR_HALF_LENGTH, cubes.getX()[k], cubes.getZ()[k], cubes.getR()[k]))
+            return 1;
+    return 0;
+}
+
+// Function to write text to the file at path. Returns 1 on success.
+static int writeText(const std::string& path, const std::string& text)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+        return 0;
+    int ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    return fclose(file) == 0 && ok;
+}
+
+// Function to read the text level at path with and without a distance field, and
+// from the level file it compiles to, and check the three against the brute
+// force at poses random poses. Returns the number of mismatches, or -1 if a file
+// cannot be read or written.
+static int checkTextLevel(const std::string& path, const std::string& levelPath, int poses, std::mt19937& random)
+{
+    ObstacleField fields[3];
+    std::string error;
+
+    for (int f = 0; f < 2; f++)
+    {
+        fields[f].bakeDistanceField = f;
+        if (!readTextLevel(path.c_str(), fields[f], error))
+        {
+            fprintf(stderr, "%s: %s\n", path.c_str(), error.c_str());
+            return -1;
+        }
+        fields[f].build();
+    }
+    if (!saveLevelFile(levelPath.c_str(), fields[1]) || !loadLevelFile(levelPath.c_str(), fields[2], 1))
+    {
+        fprintf(stderr, "%s: cannot compile\n", levelPath.c_str());
+        return -1;
+    }
+
+    const CubeStore& cubes = fields[0].cubes;
+    std::uniform_real_distribution<float> randomX(-TINY_EXTENT - 10.0f, TINY_EXTENT + 10.0f);
+    std::uniform_real_distribution<float> randomZ(-2 * TINY_EXTENT - 10.0f, 10.0f);
+    std::uniform_real_distribution<float> randomAngle(0.0f, 360.0f);
+    int mismatches = 0, hitCount = 0;
+    for (int n = 0; n < poses + cubes.getCount(); n++)
+    {
+        CarPose pose = n < cubes.getCount() ? makeCarPose(cubes.getX()[n], cubes.getZ()[n], 0.0f) :
+            makeCarPose(randomX(random), randomZ(random), randomAngle(random));
+        int expected = bruteForceCollision(cubes, pose);
+        hitCount += expected;
+        for (int f = 0; f < 3; f++)
+            mismatches += fields[f].cubeCarCollision(pose) != expected;
+    }
+    printf("%s: %d cubes, %d of %d poses hit, %d mismatches\n", path.c_str(), cubes.getCount(), hitCount,
+        poses + cubes.getCount(), mismatches);
+    return mismatches;
+}
+
+// Main routine.
+int main(int argc, char** argv)
+{
+    int poses = 100000, seed = 1, failures = 0;
+    std::string prefix = "textlevel_test";
+
+    for (int n = 1; n < argc; n++)
+        if (!strcmp(argv[n], "--poses") && n + 1 < argc)
+            poses = atoi(argv[++n]);
+        else if (!strcmp(argv[n], "--seed") && n + 1 < argc)
+            seed = atoi(argv[++n]);
+        else if (!strcmp(argv[n], "--prefix") && n + 1 < argc)
+            prefix = argv[++n];
+        else
+        {
+            fprintf(stderr, "Usage: %s [--poses N] [--seed S] [--prefix P]\n", argv[0]);
+            return 1;
+        }
+
+    // A single cube no texel center falls in, then cubes of a fifth to a whole
+    // texel wide at positions given to the hundredth, in CSV and in JSON.
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> randomX(-TINY_EXTENT, TINY_EXTENT), randomZ(-2 * TINY_EXTENT, 0.0f);
+    std::uniform_real_distribution<float> randomSize(0.2f, 1.0f);
+    std::string csv = "# Cubes smaller than a texel.\n", json = "{ \"name\": \"tiny\", \"cubes\": [\n";
+    char line[128];
+    for (int k = 0; k < TINY_CUBES; k++)
+    {
+        float x = randomX(random), z = randomZ(random), size = randomSize(random);
+        snprintf(line, sizeof(line), "cube,%.2f,%.2f,%.2f\n", x, z, size);
+        csv += line;
+        snprintf(line, sizeof(line), "%s  { \"x\": %.2f, \"z\": %.2f, \"size\": %.2f }", k ? ",\n" : "", x, z, size);
+        json += line;
+    }
+    csv += "goal,0,-100\n";
+    json += "\n], \"triggers\": [ { \"type\": \"goal\", \"x\": 0, \"z\": -100 } ] }\n";
+
+    const char* texts[3] = { "cube,10.3,-20.7,0.8\n", csv.c_str(), json.c_str() };
+    const char* extensions[3] = { ".csv", ".csv", ".json" };
+    std::string levelPath = prefix + ".clvl";
+    for (int l = 0; l < 3; l++)
+    {
+        std::string path = prefix + extensions[l];
+        if (!writeText(path, texts[l]))
+            fprintf(stderr, "%s: cannot write\n", path.c_str());
+        int mismatches = checkTextLevel(path, levelPath, poses, random);
+        failures += mismatches < 0 ? 1 : mismatches;
+        remove(path.c_str());
+    }
+    remove(levelPath.c_str());
+    printf(failures ? "FAILED\n" : "passed\n");
+    return failures != 0;
+}
@@ -0,0 +1,171 @@
+// Timer wheel and world reset test. Runs headless, no window is opened.
+//
+// Build: g++ -O2 -std=c++17 timer_test.cpp -o timer_test -lpthread
+// Usage: timer_test [--rounds N] [--seed S]
+//
+// Runs rounds of random schedule(), cancel() and advance() calls on a TimerWheel
+// and on a reference ordered multimap keyed by deadline and scheduling order,
+// and checks that both fire the same timers at the same ticks in the same order.
+// Delays range beyond the top level of the wheel, and some timers are coalesced.
+// Then drives a World straight ahead until the game is over and checks that it
+// resets itself RESET_DELAY_STEPS after that, also after a snapshot taken while
+// the reset was pending is restored. Prints the mismatches found and returns 1
+// if there are any.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "world.h"
+
+#define TEST_EVENTS 4 // Distinct events, so coalesced timers meet pending ones.
+#define TEST_VALUES 4 // Distinct values of each event.
+
+// Reference timer of the test.
+struct ReferenceTimer
+{
+    int event, value, coalesce;
+    TimerHandle handle; // Handle of the same timer on the wheel.
+};
+
+// Function to check the wheel against the reference over rounds random rounds.
+// Returns the number of mismatches.
+static int checkWheel(int rounds, Pcg32& random)
+{
+    TimerWheel wheel;
+    std::multimap<std::pair<uint64_t, uint64_t>, ReferenceTimer> reference; // By deadline, then order.
+    std::vector<TimerHandle> handles; // Every handle handed out, pending or not.
+    std::vector<std::pair<int, int> > fired, expected;
+    uint64_t now = 0, sequence = 0;
+    int mismatches = 0;
+
+    for (int round = 0; round < rounds; round++)
+    {
+        uint32_t choice = random.nextBelow(10);
+        if (choice < 5)
+        {
+            // Schedule, mostly short delays but some past the top level.
+            uint32_t bits = random.nextBelow(26);
+            uint32_t delay = random.next() & ((1u << bits) - 1);
+            int event = (int)random.nextBelow(TEST_EVENTS), value = (int)random.nextBelow(TEST_VALUES);
+            int coalesce = random.nextBelow(4) == 0;
+            TimerHandle handle = wheel.schedule(delay, event, value, coalesce);
+
+            auto found = reference.end();
+            if (coalesce)
+                for (auto t = reference.begin(); t != reference.end(); ++t)
+                    if (t->second.coalesce && t->second.event == event && t->second.value == value)
+                        found = t;
+            if (found != reference.end())
+                mismatches += found->second.handle.index != handle.index ||
+                    found->second.handle.generation != handle.generation;
+            else
+            {
+                ReferenceTimer timer = { event, value, coalesce, handle };
+                reference.insert(std::make_pair(std::make_pair(now + (delay > 0 ? delay : 1), sequence++), timer));
+            }
+            handles.push_back(handle);
+        }
+        else if (choice < 7 && !handles.empty())
+        {
+            // Cancel a handle, which may have fired or been cancelled already.
+            TimerHandle handle = handles[random.nextBelow((uint32_t)handles.size())];
+            int pending = 0;
+            for (auto t = reference.begin(); t != reference.end(); ++t)
+                if (t->second.handle.index == handle.index && t->second.handle.generation == handle.generation)
+                {
+                    reference.erase(t);
+                    pending = 1;
+                    break;
+                }
+            mismatches += wheel.cancel(handle) != pending;
+        }
+        else
+        {
+            // Advance, mostly a few ticks but sometimes far.
+            uint32_t ticks = random.nextBelow(8) == 0 ? random.nextBelow(1u << 20) : random.nextBelow(100);
+            fired.clear();
+            expected.clear();
+            wheel.advance(ticks, [&](int event, int value) { fired.push_back(std::make_pair(event, value)); });
+            now += ticks;
+            while (!reference.empty() && reference.begin()->first.first <= now)
+            {
+                expected.push_back(std::make_pair(reference.begin()->second.event, reference.begin()->second.value));
+                reference.erase(reference.begin());
+            }
+            mismatches += fired != expected;
+        }
+        mismatches += wheel.getPendingCount() != (int)reference.size() || wheel.getTime() != now;
+    }
+    return mismatches;
+}
+
+// Function returning the steps the world takes to reset after the step in which
+// the car driving straight ahead into a full layout loses or wins. If rewindAfter
+// is nonzero, a snapshot taken that many steps after the end is restored ten
+// steps later, and the steps taken again are not counted.
+static int stepsToReset(int rewindAfter)
+{
+    World world;
+    std::vector<unsigned char> snapshot;
+    int step, endStep = -1, events, restored = 0;
+
+    world.seed(1);
+    world.generateLayout(makeLayoutParams(8, 6, 100));
+    for (step = 0; step < 100000; step++)
+    {
+        events = world.step(INPUT_FORWARD);
+        if (events & EVENT_RESET)
+            return step - endStep;
+        if (events & (EVENT_LOST | EVENT_WON))
+            endStep = step;
+        if (endStep >= 0 && rewindAfter > 0 && step == endStep + rewindAfter)
+        {
+            snapshot.resize(world.getSnapshotSize());
+            world.saveSnapshot(snapshot.data());
+        }
+        if (endStep >= 0 && rewindAfter > 0 && step == endStep + rewindAfter + 10 && !restored)
+        {
+            if (!world.loadSnapshot(snapshot.data()))
+                return -1;
+            endStep += 10; // The ten steps since the snapshot are taken again.
+            restored = 1;
+        }
+    }
+    return -1;
+}
+
+// Main routine.
+int main(int argc, char** argv)
+{
+    int rounds = 20000, seed = 1, failures = 0;
+
+    for (int n = 1; n < argc; n++)
+        if (!strcmp(argv[n], "--rounds") && n + 1 < argc)
+            rounds = atoi(argv[++n]);
+        else if (!strcmp(argv[n], "--seed") && n + 1 < argc)
+            seed = atoi(argv[++n]);
+        else
+        {
+            fprintf(stderr, "Usage: %s [--rounds N] [--seed S]\n", argv[0]);
+            return 1;
+        }
+
+    Pcg32 random(seed, 0);
+    int mismatches = checkWheel(rounds, random);
+    printf("timer wheel: %d rounds, %d mismatches\n", rounds, mismatches);
+    failures += mismatches;
+
+    // The reset fires in the step RESET_DELAY_STEPS - 1 after the end, counting
+    // the step of the end as the first.
+    int direct = stepsToReset(0), rewound = stepsToReset(RESET_DELAY_STEPS / 2);
+    printf("world reset: %d steps after the end, %d with a snapshot restored, %d expected\n", direct, rewound,
+        RESET_DELAY_STEPS - 1);
+    failures += direct != RESET_DELAY_STEPS - 1;
+    failures += rewound != RESET_DELAY_STEPS - 1;
+
+    printf(failures ? "FAILED\n" : "passed\n");
+    return failures != 0;
+}
@@ -0,0 +1,261 @@
+// Scheduling of game events in simulation ticks.
+#ifndef TIMERS_H
+#define TIMERS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#define TIMER_WHEEL_BITS 6 // Each level of the wheel has 1 << TIMER_WHEEL_BITS slots.
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4 // Levels of the wheel, enough for delays of 2^24 ticks.
+
+// Handle of a scheduled timer. Stays safe to use after the timer has fired or
+// been cancelled: it then simply no longer refers to a pending timer.
+struct TimerHandle
+{
+    uint32_t index; // Entry in the timer pool.
+    uint32_t generation; // Use of the entry, 0 for no timer.
+};
+
+// Hierarchical timer wheel. Time is counted in ticks, which the owner advances;
+// the game ticks it once per world step, so it needs no GLUT and runs the same
+// headless. Scheduling and cancelling take constant time: a timer goes into the
+// slot of the level matching its delay, and level L slots are spread out over
+// the slots below as the time reaches them. Timers due on the same tick fire in
+// the order they were scheduled.
+class TimerWheel
+{
+public:
+    TimerWheel();
+    TimerHandle schedule(uint32_t delay, int event, int value = 0, int coalesce = 0);
+    int cancel(TimerHandle handle);
+    int isPending(TimerHandle handle) const;
+    template <typename Fire>
+    void advance(uint32_t ticks, Fire fire);
+    uint64_t getTime() const { return now; }
+    int getPendingCount() const { return pendingCount; }
+
+private:
+    struct Timer
+    {
+        uint64_t deadline; // Tick at which the timer fires.
+        uint64_t sequence; // Order in which timers were scheduled.
+        int event, value; // Passed to the fire callback.
+        uint32_t generation; // Bumped each time the entry is released.
+        int slot; // Slot list holding the timer, or -1 if none.
+        int previous, next; // Neighbours in the slot list, or -1.
+        int coalesced; // Is the timer in pendingKeys?
+    };
+
+    static uint64_t key(int event, int value) { return (uint64_t)(uint32_t)event << 32 | (uint32_t)value; }
+    void insert(int t);
+    void unlink(int t);
+    void release(int t);
+    void cascade(int level);
+
+    std::vector<Timer> timers; // Pool of timer entries.
+    std::vector<int> freeTimers; // Entries of the pool not in use.
+    int slots[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS]; // First timer of each slot list, or -1.
+    std::unordered_map<uint64_t, int> pendingKeys; // Coalesced timer pending for each event and value.
+    std::vector<std::pair<uint64_t, TimerHandle> > due; // Timers firing on the current tick, with their sequence.
+    uint64_t now; // Current tick.
+    uint64_t sequence; // Number of timers scheduled so far.
+    int pendingCount; // Number of timers scheduled and not fired or cancelled.
+};
+
+// TimerWheel constructor.
+inline TimerWheel::TimerWheel()
+{
+    for (int s = 0; s < TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS; s++)
+        slots[s] = -1;
+    now = 0;
+    sequence = 0;
+    pendingCount = 0;
+}
+
+// Function to schedule event with value to fire delay ticks from now, at least
+// one tick later. If coalesce is set and a coalesced timer for the same event
+// and value is already pending, no new timer is added and the pending one is
+// returned, so repeated requests for the same event do not stack up.
+inline TimerHandle TimerWheel::schedule(uint32_t delay, int event, int value, int coalesce)
+{
+    TimerHandle handle;
+    int t;
+
+    if (coalesce)
+    {
+        auto found = pendingKeys.find(key(event, value));
+        if (found != pendingKeys.end())
+        {
+            handle.index = found->second;
+            handle.generation = timers[found->second].generation;
+            return handle;
+        }
+    }
+
+    if (!freeTimers.empty())
+    {
+        t = freeTimers.back();
+        freeTimers.pop_back();
+    }
+    else
+    {
+        t = (int)timers.size();
+        timers.push_back(Timer());
+        timers[t].generation = 1;
+    }
+
+    Timer& timer = timers[t];
+    timer.deadline = now + (delay > 0 ? delay : 1);
+    timer.sequence = sequence++;
+    timer.event = event;
+    timer.value = value;
+    timer.coalesced = coalesce;
+    if (coalesce)
+        pendingKeys[key(event, value)] = t;
+    insert(t);
+    pendingCount++;
+
+    handle.index = t;
+    handle.generation = timer.generation;
+    return handle;
+}
+
+// Function to check if handle refers to a timer that has not fired or been
+// cancelled yet.
+inline int TimerWheel::isPending(TimerHandle handle) const
+{
+    return handle.generation != 0 && handle.index < timers.size() &&
+        timers[handle.index].generation == handle.generation;
+}
+
+// Function to cancel the timer of handle. Returns 1 if it was pending and 0 if it
+// had already fired or been cancelled.
+inline int TimerWheel::cancel(TimerHandle handle)
+{
+    if (!isPending(handle))
+        return 0;
+    unlink(handle.index);
+    release(handle.index);
+    return 1;
+}
+
+// Function to add timer t to the slot list for its deadline. Timers due within
+// TIMER_WHEEL_SLOTS ticks go into level 0, those due within TIMER_WHEEL_SLOTS^2
+// ticks into level 1 and so on; delays beyond the top level wait in it and are
+// placed again each time it comes round.
+inline void TimerWheel::insert(int t)
+{
+    Timer& timer = timers[t];
+    uint64_t delta = timer.deadline - now;
+    int level = 0;
+
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (uint64_t)1 << (TIMER_WHEEL_BITS * (level + 1)))
+        level++;
+    uint64_t deadline = level == TIMER_WHEEL_LEVELS - 1 &&
+        delta >= (uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS) ?
+        now + ((uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1 : timer.deadline;
+
+    timer.slot = level * TIMER_WHEEL_SLOTS + (int)((deadline >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+    timer.previous = -1;
+    timer.next = slots[timer.slot];
+    if (timer.next >= 0)
+        timers[timer.next].previous = t;
+    slots[timer.slot] = t;
+}
+
+// Function to remove timer t from its slot list, if it is in one.
+inline void TimerWheel::unlink(int t)
+{
+    Timer& timer = timers[t];
+
+    if (timer.slot < 0)
+        return;
+    if (timer.previous >= 0)
+        timers[timer.previous].next = timer.next;
+    else
+        slots[timer.slot] = timer.next;
+    if (timer.next >= 0)
+        timers[timer.next].previous = timer.previous;
+    timer.slot = -1;
+}
+
+// Function to return the entry of timer t, which is in no slot list, to the pool.
+inline void TimerWheel::release(int t)
+{
+    Timer& timer = timers[t];
+
+    if (timer.coalesced)
+        pendingKeys.erase(key(timer.event, timer.value));
+    if (++timer.generation == 0)
+        timer.generation = 1; // 0 is never a valid generation.
+    freeTimers.push_back(t);
+    pendingCount--;
+}
+
+// Function to move the timers of the current slot of level down to the levels
+// below, now that the time has reached the range of ticks the slot covers.
+inline void TimerWheel::cascade(int level)
+{
+    int slot = level * TIMER_WHEEL_SLOTS + (int)((now >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+    int t = slots[slot];
+
+    slots[slot] = -1;
+    while (t >= 0)
+    {
+        int next = timers[t].next;
+        insert(t);
+        t = next;
+    }
+}
+
+// Function to advance the time by ticks, calling fire(event, value) for each timer
+// that comes due, in order of deadline and then of scheduling. fire may schedule
+// and cancel timers, but not advance this wheel; a timer it cancels that is due on
+// the same tick does not fire.
+template <typename Fire>
+void TimerWheel::advance(uint32_t ticks, Fire fire)
+{
+    for (uint32_t tick = 0; tick < ticks; tick++)
+    {
+        now++;
+
+        // Bring down the timers of the higher levels whose range starts now.
+        for (int level = 1; level < TIMER_WHEEL_LEVELS; level++)
+        {
+            if (now & (((uint64_t)1 << (TIMER_WHEEL_BITS * level)) - 1))
+                break;
+            cascade(level);
+        }
+
+        // Take the due timers out of their slot and fire them in scheduling order.
+        int slot = (int)(now & (TIMER_WHEEL_SLOTS - 1)), t = slots[slot];
+        if (t < 0)
+            continue;
+        due.clear();
+        slots[slot] = -1;
+        for (; t >= 0; t = timers[t].next)
+        {
+            TimerHandle handle = { (uint32_t)t, timers[t].generation };
+            timers[t].slot = -1;
+            due.push_back(std::make_pair(timers[t].sequence, handle));
+        }
+        std::sort(due.begin(), due.end(), [](const std::pair<uint64_t, TimerHandle>& a,
+            const std::pair<uint64_t, TimerHandle>& b) { return a.first < b.first; });
+
+        for (size_t n = 0; n < due.size(); n++)
+        {
+            TimerHandle handle = due[n].second;
+            if (!isPending(handle))
+                continue; // Cancelled by an earlier callback.
+            int event = timers[handle.index].event, value = timers[handle.index].value;
+            release(handle.index);
+            fire(event, value);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,138 @@
+// Trigger volumes: goals, checkpoints and hazards on the ground plane.
+#ifndef TRIGGERS_H
+#define TRIGGERS_H
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "collision.h"
+#include "bvh.h"
+
+#define TRIGGER_GOAL 0 // Reaching it wins the game.
+#define TRIGGER_CHECKPOINT 1 // Reaching it is recorded.
+#define TRIGGER_HAZARD 2 // Reaching it loses the game.
+
+// Structure-of-arrays store of circular trigger areas. The car sets off a trigger
+// when its center is inside the circle.
+class TriggerStore
+{
+public:
+    TriggerStore() { count = 0; }
+    void clear();
+    int add(float x, float z, float r, int type);
+    void permute(const int* order, int numTriggers);
+    void write(BlockWriter& out) const;
+    int read(BlockReader& in);
+    int getCount() const { return count; }
+    const float* getX() const { return centerX.data(); }
+    const float* getZ() const { return centerZ.data(); }
+    const float* getR() const { return radius.data(); }
+    int getType(int k) const { return type[k]; }
+
+private:
+    int count;
+    MappedArray<float> centerX, centerZ, radius;
+    MappedArray<unsigned char> type; // One of the TRIGGER_* values.
+};
+
+// Function to remove all triggers.
+inline void TriggerStore::clear()
+{
+    count = 0;
+    centerX.clear();
+    centerZ.clear();
+    radius.clear();
+    type.clear();
+}
+
+// Function to append a trigger and return its index.
+inline int TriggerStore::add(float x, float z, float r, int t)
+{
+    centerX.push_back(x);
+    centerZ.push_back(z);
+    radius.push_back(r);
+    type.push_back((unsigned char)t);
+    return count++;
+}
+
+// Function to reorder the triggers so that the new trigger n is the old trigger
+// order[n], for n below numTriggers.
+inline void TriggerStore::permute(const int* order, int numTriggers)
+{
+    TriggerStore sorted;
+    for (int n = 0; n < numTriggers; n++)
+    {
+        int k = order[n];
+        sorted.add(getX()[k], getZ()[k], getR()[k], getType(k));
+    }
+    *this = std::move(sorted);
+}
+
+// Function to write the triggers to out.
+inline void TriggerStore::write(BlockWriter& out) const
+{
+    out.array(centerX.data(), count);
+    out.array(centerZ.data(), count);
+    out.array(radius.data(), count);
+    out.array(type.data(), count);
+}
+
+// Function to read triggers written by write() from in. Returns 1 on success and
+// 0 if the blocks do not hold a store of triggers, or if a trigger has a type
+// other than the TRIGGER_* values or a radius that is not positive and finite,
+// which findTriggers() could not handle.
+inline int TriggerStore::read(BlockReader& in)
+{
+    TriggerStore loaded;
+
+    if (!in.array(loaded.centerX) || !in.array(loaded.centerZ) || !in.array(loaded.radius) || !in.array(loaded.type))
+        return 0;
+    loaded.count = (int)loaded.centerX.size();
+    if (loaded.centerZ.size() != loaded.centerX.size() || loaded.radius.size() != loaded.centerX.size() ||
+        loaded.type.size() != loaded.centerX.size())
+        return 0;
+    const float* r = loaded.radius.begin();
+    const unsigned char* t = loaded.type.begin();
+    for (int k = 0; k < loaded.count; k++)
+        if (t[k] > TRIGGER_HAZARD || !(r[k] > 0) || !std::isfinite(r[k]))
+            return 0;
+    *this = std::move(loaded);
+    return 1;
+}
+
+// Function to sort the triggers of store into cell order and build grid over them.
+inline void buildTriggerGrid(TriggerStore& store, UniformGrid& grid, float cellSize)
+{
+    grid.build(store.getX(), store.getZ(), store.getR(), store.getCount(), cellSize);
+    store.permute(grid.getItems().data(), (int)grid.getItems().size());
+    grid.build(store.getX(), store.getZ(), store.getR(), store.getCount(), cellSize);
+}
+
+// Function to sort the triggers of store into leaf order and build bvh over them.
+inline void buildTriggerBVH(TriggerStore& store, SphereBVH& bvh)
+{
+    bvh.build(store.getX(), store.getZ(), store.getR(), store.getCount());
+    store.permute(bvh.getItems().data(), (int)bvh.getItems().size());
+    bvh.markSorted();
+}
+
+// Function to check which of the triggers in [begin, end) of store contain the
+// point (x, z). Returns a bitmask with bit (1 << type) set for each type found
+// and calls found(k) for each trigger k found.
+template <typename Found>
+int findTriggers(const TriggerStore& store, int begin, int end, float x, float z, Found found)
+{
+    const float* cx = store.getX(), * cz = store.getZ(), * cr = store.getR();
+    int mask = 0;
+
+    for (int k = begin; k < end; k++)
+        if ((x - cx[k]) * (x - cx[k]) + (z - cz[k]) * (z - cz[k]) <= cr[k] * cr[k])
+        {
+            mask |= 1 << store.getType(k);
+            found(k);
+        }
+    return mask;
+}
+
+#endif
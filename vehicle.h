@@ -0,0 +1,223 @@
+// Kinematic bicycle model of the car.
+#ifndef VEHICLE_H
+#define VEHICLE_H
+
+#ifndef _USE_MATH_DEFINES
+#define _USE_MATH_DEFINES
+#endif
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VEHICLE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#define STEPS_PER_SECOND 30 // World steps per second of game time.
+#define STEP_SECONDS (1.0f / STEPS_PER_SECOND) // Game time advanced by one world step.
+#define WHEELBASE 8.0f // Distance between the front and rear wheels drawn in drawCar().
+#define MAX_STEER_ANGLE 30.0f // Largest angle of the front wheels in degrees.
+#define MAX_SPEED 30.0f // Top forward speed in units per second.
+#define MAX_REVERSE_SPEED 10.0f // Top reverse speed in units per second.
+#define ACCELERATION 20.0f // Acceleration at full throttle in units per second squared.
+#define BRAKE_DECELERATION 60.0f // Deceleration at full brake in units per second squared.
+#define ROLLING_DECELERATION 5.0f // Deceleration with neither throttle nor brake.
+
+// Driver controls of the car for one step.
+struct CarControls
+{
+    float throttle; // -1 (full reverse) to 1 (full forward).
+    float brake; // 0 to 1.
+    float steer; // -1 (full right) to 1 (full left).
+};
+
+#define VEHICLE_LANES 4 // Cars stepped at once by integrateVehicles().
+
+// Taylor coefficients of sine and cosine, enough for float accuracy over the
+// eighth of a turn the angles are reduced to.
+#define VEHICLE_SIN3 (-1.0f / 6.0f)
+#define VEHICLE_SIN5 (1.0f / 120.0f)
+#define VEHICLE_SIN7 (-1.0f / 5040.0f)
+#define VEHICLE_COS2 (-1.0f / 2.0f)
+#define VEHICLE_COS4 (1.0f / 24.0f)
+#define VEHICLE_COS6 (-1.0f / 720.0f)
+#define VEHICLE_COS8 (1.0f / 40320.0f)
+
+#ifdef VEHICLE_SSE2
+// Function to select a where mask is set and b elsewhere.
+inline __m128 vehicleSelect(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Function to set sine and cosine to those of the four angles in degrees. Each
+// angle is reduced to the nearest multiple of 90 degrees and the rest taken by
+// polynomials, to within about 3e-7. Only plain float operations are used, so
+// the result is the same on every machine with SSE2.
+inline void vehicleSinCos4(__m128 angle, __m128& sine, __m128& cosine)
+{
+    __m128 zero = _mm_setzero_ps(), sign = _mm_set1_ps(-0.0f);
+    __m128 scaled = _mm_mul_ps(angle, _mm_set1_ps(1.0f / 90.0f));
+    __m128 half = vehicleSelect(_mm_cmplt_ps(scaled, zero), _mm_set1_ps(-0.5f), _mm_set1_ps(0.5f));
+    __m128i quadrant = _mm_cvttps_epi32(_mm_add_ps(scaled, half));
+    __m128 t = _mm_mul_ps(_mm_sub_ps(angle, _mm_mul_ps(_mm_cvtepi32_ps(quadrant), _mm_set1_ps(90.0f))),
+        _mm_set1_ps((float)(M_PI / 180.0)));
+    __m128 t2 = _mm_mul_ps(t, t);
+    __m128 s = _mm_add_ps(t, _mm_mul_ps(_mm_mul_ps(t, t2), _mm_add_ps(_mm_set1_ps(VEHICLE_SIN3),
+        _mm_mul_ps(t2, _mm_add_ps(_mm_set1_ps(VEHICLE_SIN5), _mm_mul_ps(t2, _mm_set1_ps(VEHICLE_SIN7)))))));
+    __m128 c = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(t2, _mm_add_ps(_mm_set1_ps(VEHICLE_COS2),
+        _mm_mul_ps(t2, _mm_add_ps(_mm_set1_ps(VEHICLE_COS4), _mm_mul_ps(t2, _mm_add_ps(_mm_set1_ps(VEHICLE_COS6),
+        _mm_mul_ps(t2, _mm_set1_ps(VEHICLE_COS8)))))))));
+
+    // Odd quadrants swap sine and cosine; the sine is negative in quadrants 2 and
+    // 3, the cosine in quadrants 1 and 2.
+    __m128i one = _mm_set1_epi32(1), two = _mm_set1_epi32(2);
+    __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+    __m128 negateSine = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, two), two));
+    __m128 negateCosine = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_add_epi32(quadrant, one), two), two));
+    sine = _mm_xor_ps(vehicleSelect(swap, c, s), _mm_and_ps(negateSine, sign));
+    cosine = _mm_xor_ps(vehicleSelect(swap, s, c), _mm_and_ps(negateCosine, sign));
+}
+
+// Function to advance the four cars at x[0] to x[3] and so on by one step, see
+// integrateVehicle().
+inline void integrateVehicles4(float* x, float* z, float* angle, float* speed,
+    float* headingX, float* headingZ, const float* throttle, const float* brake, const float* steer)
+{
+    __m128 zero = _mm_setzero_ps(), sign = _mm_set1_ps(-0.0f), step = _mm_set1_ps(STEP_SECONDS);
+    __m128 t = _mm_loadu_ps(throttle), b = _mm_loadu_ps(brake), v = _mm_loadu_ps(speed);
+
+    __m128 opposing = _mm_and_ps(_mm_cmplt_ps(_mm_mul_ps(t, v), zero), _mm_andnot_ps(sign, t));
+    __m128 coasting = _mm_and_ps(_mm_and_ps(_mm_cmpeq_ps(t, zero), _mm_cmpeq_ps(b, zero)),
+        _mm_set1_ps(ROLLING_DECELERATION));
+    __m128 slowdown = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(BRAKE_DECELERATION),
+        _mm_min_ps(_mm_add_ps(b, opposing), _mm_set1_ps(1.0f))), coasting), step);
+    __m128 slowed = vehicleSelect(_mm_cmpgt_ps(v, zero), _mm_max_ps(_mm_sub_ps(v, slowdown), zero),
+        _mm_min_ps(_mm_add_ps(v, slowdown), zero));
+    __m128 driven = vehicleSelect(_mm_cmpeq_ps(opposing, zero),
+        _mm_add_ps(slowed, _mm_mul_ps(_mm_mul_ps(t, _mm_set1_ps(ACCELERATION)), step)), slowed);
+    v = _mm_min_ps(_mm_max_ps(driven, _mm_set1_ps(-MAX_REVERSE_SPEED)), _mm_set1_ps(MAX_SPEED));
+
+    __m128 steerSine, steerCosine, sine, cosine;
+    vehicleSinCos4(_mm_mul_ps(_mm_loadu_ps(steer), _mm_set1_ps(MAX_STEER_ANGLE)), steerSine, steerCosine);
+    __m128 turn = _mm_mul_ps(_mm_div_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps((float)(180.0 / M_PI)), v),
+        _mm_div_ps(steerSine, steerCosine)), _mm_set1_ps(WHEELBASE)), step);
+    __m128 a = _mm_add_ps(_mm_loadu_ps(angle), turn);
+    vehicleSinCos4(a, sine, cosine);
+    __m128 hx = _mm_xor_ps(sine, sign), hz = _mm_xor_ps(cosine, sign);
+
+    _mm_storeu_ps(x, _mm_add_ps(_mm_loadu_ps(x), _mm_mul_ps(_mm_mul_ps(v, step), hx)));
+    _mm_storeu_ps(z, _mm_add_ps(_mm_loadu_ps(z), _mm_mul_ps(_mm_mul_ps(v, step), hz)));
+    _mm_storeu_ps(angle, a);
+    _mm_storeu_ps(speed, v);
+    _mm_storeu_ps(headingX, hx);
+    _mm_storeu_ps(headingZ, hz);
+}
+#endif
+
+// Function to set sine and cosine to those of angle in degrees, computed the way
+// the vehicle model does. Every heading of the car comes from here or from the
+// model itself, so a pose rebuilt from its angle faces exactly the same way as
+// the one the model returned.
+inline void vehicleSinCos(float angle, float& sine, float& cosine)
+{
+#ifdef VEHICLE_SSE2
+    __m128 s, c;
+    vehicleSinCos4(_mm_set1_ps(angle), s, c);
+    sine = _mm_cvtss_f32(s);
+    cosine = _mm_cvtss_f32(c);
+#else
+    float scaled = angle * (1.0f / 90.0f);
+    int quadrant = (int)(scaled + (scaled < 0.0f ? -0.5f : 0.5f));
+    float t = (angle - (float)quadrant * 90.0f) * (float)(M_PI / 180.0);
+    float t2 = t * t;
+    float s = t + t * t2 * (VEHICLE_SIN3 + t2 * (VEHICLE_SIN5 + t2 * VEHICLE_SIN7));
+    float c = 1.0f + t2 * (VEHICLE_COS2 + t2 * (VEHICLE_COS4 + t2 * (VEHICLE_COS6 + t2 * VEHICLE_COS8)));
+    sine = quadrant & 1 ? c : s;
+    cosine = quadrant & 1 ? s : c;
+    sine = quadrant & 2 ? -sine : sine;
+    cosine = (quadrant + 1) & 2 ? -cosine : cosine;
+#endif
+}
+
+// Function to advance count cars stored as a structure of arrays by one step,
+// car k with controls throttle[k], brake[k] and steer[k]. With SSE2 the cars are
+// stepped VEHICLE_LANES at a time, the last few through a padded copy, so every
+// car takes the same instructions whether it is stepped alone by a World or with
+// thousands of others by a WorldBatch, and the two agree to the bit. Builds that
+// fuse multiplies and adds, such as -march=native without -ffp-contract=off,
+// round differently, so a replay only matches on a build that agrees on that.
+inline void integrateVehicles(int count, float* x, float* z, float* angle, float* speed,
+    float* headingX, float* headingZ, const float* throttle, const float* brake, const float* steer)
+{
+#ifdef VEHICLE_SSE2
+    int k;
+    for (k = 0; k + VEHICLE_LANES <= count; k += VEHICLE_LANES)
+        integrateVehicles4(x + k, z + k, angle + k, speed + k, headingX + k, headingZ + k,
+            throttle + k, brake + k, steer + k);
+    if (k == count)
+        return;
+
+    float lanes[9][VEHICLE_LANES] = {};
+    int n, rest = count - k;
+    for (n = 0; n < rest; n++)
+    {
+        lanes[0][n] = x[k + n];
+        lanes[1][n] = z[k + n];
+        lanes[2][n] = angle[k + n];
+        lanes[3][n] = speed[k + n];
+        lanes[6][n] = throttle[k + n];
+        lanes[7][n] = brake[k + n];
+        lanes[8][n] = steer[k + n];
+    }
+    integrateVehicles4(lanes[0], lanes[1], lanes[2], lanes[3], lanes[4], lanes[5], lanes[6], lanes[7], lanes[8]);
+    for (n = 0; n < rest; n++)
+    {
+        x[k + n] = lanes[0][n];
+        z[k + n] = lanes[1][n];
+        angle[k + n] = lanes[2][n];
+        speed[k + n] = lanes[3][n];
+        headingX[k + n] = lanes[4][n];
+        headingZ[k + n] = lanes[5][n];
+    }
+#else
+    for (int k = 0; k < count; k++)
+    {
+        // Braking force: the brake, throttle against the motion, and rolling
+        // resistance when coasting. It slows the car down but never turns it around.
+        float v = speed[k], t = throttle[k], b = brake[k];
+        float opposing = t * v < 0.0f ? fabsf(t) : 0.0f;
+        float coasting = t == 0.0f && b == 0.0f ? ROLLING_DECELERATION : 0.0f;
+        float slowdown = (BRAKE_DECELERATION * fminf(b + opposing, 1.0f) + coasting) * STEP_SECONDS;
+        float slowed = v > 0.0f ? fmaxf(v - slowdown, 0.0f) : fminf(v + slowdown, 0.0f);
+
+        // Driving force, only when the throttle is with the motion or the car is at rest.
+        float driven = opposing == 0.0f ? slowed + t * ACCELERATION * STEP_SECONDS : slowed;
+        v = fminf(fmaxf(driven, -MAX_REVERSE_SPEED), MAX_SPEED);
+
+        // Heading rate of the bicycle model, then move along the new heading.
+        float steerSine, steerCosine, sine, cosine;
+        vehicleSinCos(steer[k] * MAX_STEER_ANGLE, steerSine, steerCosine);
+        angle[k] += (float)(180.0 / M_PI) * v * (steerSine / steerCosine) / WHEELBASE * STEP_SECONDS;
+        vehicleSinCos(angle[k], sine, cosine);
+        headingX[k] = -sine;
+        headingZ[k] = -cosine;
+        x[k] += v * STEP_SECONDS * headingX[k];
+        z[k] += v * STEP_SECONDS * headingZ[k];
+        speed[k] = v;
+    }
+#endif
+}
+
+// Function to advance the car at (x, z) with heading angle in degrees to the -z
+// direction and signed speed along it by one step of the kinematic bicycle model.
+// The speed is updated first and then moves the car along the heading the front
+// wheels turn it to. Throttle against the direction of travel brakes. The unit
+// vector (headingX, headingZ) the car faces afterwards is returned too, so the
+// new pose needs no trigonometry of its own.
+inline void integrateVehicle(float& x, float& z, float& angle, float& speed, float& headingX, float& headingZ,
+    float throttle, float brake, float steer)
+{
+    integrateVehicles(1, &x, &z, &angle, &speed, &headingX, &headingZ, &throttle, &brake, &steer);
+}
+
+#endif
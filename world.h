@@ -0,0 +1,374 @@
+// Simulation state of the car game and the rules that advance it. Needs no
+// OpenGL or GLUT, so any number of worlds can be stepped headless.
+#ifndef WORLD_H
+#define WORLD_H
+
+#ifndef _USE_MATH_DEFINES
+#define _USE_MATH_DEFINES
+#endif
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "chunks.h"
+#include "level.h"
+#include "obstacles.h"
+#include "timers.h"
+#include "vehicle.h"
+
+// Discrete inputs, each standing for one key held down. See inputControls().
+#define INPUT_NONE 0
+#define INPUT_TURN_LEFT 1
+#define INPUT_TURN_RIGHT 2
+#define INPUT_FORWARD 3
+#define INPUT_BACKWARD 4
+#define INPUT_BRAKE 5
+#define INPUT_COUNT 6
+
+// Events reported by World::step().
+#define EVENT_MOVED 1 // The car moved or turned.
+#define EVENT_LOST 2 // The car hit a cube or a hazard this step.
+#define EVENT_WON 4 // The car reached a goal this step.
+#define EVENT_RESET 8 // The world was reset this step, RESET_DELAY_STEPS after it was lost or won.
+
+#define RESET_DELAY_STEPS (3 * STEPS_PER_SECOND) // Steps from a win or loss to the automatic reset.
+
+// Events scheduled on the timer wheel of a world. The owner of the world may
+// schedule events of its own from TIMER_FIRST_USER on.
+#define TIMER_RESET_WORLD 1 // Resets the world, see World::step().
+#define TIMER_FIRST_USER 16 // First event passed to the timer handler of a world.
+
+// Function returning the controls of holding down only the key for input.
+inline CarControls inputControls(int input)
+{
+    CarControls controls = { 0.0f, 0.0f, 0.0f };
+
+    switch (input)
+    {
+    case INPUT_TURN_LEFT: controls.steer = 1.0f; break;
+    case INPUT_TURN_RIGHT: controls.steer = -1.0f; break;
+    case INPUT_FORWARD: controls.throttle = 1.0f; break;
+    case INPUT_BACKWARD: controls.throttle = -1.0f; break;
+    case INPUT_BRAKE: controls.brake = 1.0f; break;
+    default: break;
+    }
+    return controls;
+}
+
+// Keys held down, tracked as INPUT_* values. Any number of keys can be held at
+// once, for example to steer while accelerating.
+class HeldInputs
+{
+public:
+    HeldInputs() { clear(); }
+    void clear();
+    void press(int input);
+    void release(int input);
+    CarControls getControls() const;
+
+private:
+    int held[INPUT_COUNT]; // Is the key for each INPUT_* value held down?
+};
+
+// Function to release all keys.
+inline void HeldInputs::clear()
+{
+    for (int input = 0; input < INPUT_COUNT; input++)
+        held[input] = 0;
+}
+
+// Function to record that the key for input was pressed.
+inline void HeldInputs::press(int input)
+{
+    if (input > INPUT_NONE && input < INPUT_COUNT)
+        held[input] = 1;
+}
+
+// Function to record that the key for input was released.
+inline void HeldInputs::release(int input)
+{
+    if (input > INPUT_NONE && input < INPUT_COUNT)
+        held[input] = 0;
+}
+
+// Function returning the controls of the keys held: opposite keys cancel out.
+inline CarControls HeldInputs::getControls() const
+{
+    CarControls controls;
+    controls.throttle = (float)(held[INPUT_FORWARD] - held[INPUT_BACKWARD]);
+    controls.brake = (float)held[INPUT_BRAKE];
+    controls.steer = (float)(held[INPUT_TURN_LEFT] - held[INPUT_TURN_RIGHT]);
+    return controls;
+}
+
+// State of the car. Plain data, so it can be copied and compared freely.
+struct CarState
+{
+    float x, z; // Co-ordinates of the car.
+    float angle; // Angle of the car to the -z direction in degrees.
+    float speed; // Signed speed along the heading in units per second.
+    int isCollision; // Has the car hit a cube or a hazard?
+    int isWin; // Has the car reached a goal?
+};
+
+// Function returning the state a fraction t of the way from state a to state b,
+// for drawing between two steps. Flags are taken from b.
+inline CarState interpolateState(const CarState& a, const CarState& b, float t)
+{
+    CarState state = b;
+    state.x = a.x + t * (b.x - a.x);
+    state.z = a.z + t * (b.z - a.z);
+    state.angle = a.angle + t * (b.angle - a.angle);
+    return state;
+}
+
+// Function to complete the move of the car in state, whose pose is pose, through
+// field to the pose to with speed, setting reached[k] for each trigger k it
+// reaches. Returns a bitmask of the EVENT_* values that happened. The move is
+// checked for collisions along its whole length, and cut short at the first cube
+// hit. pose is kept matching state, and only rebuilt when the car moves. field is
+// an ObstacleField or a ChunkedWorld.
+template <typename Field>
+int resolveCarMove(const Field& field, CarState& state, CarPose& pose, unsigned char* reached,
+    const CarPose& to, float speed)
+{
+    if (to.x == state.x && to.z == state.z && to.angle == state.angle)
+    {
+        state.speed = speed;
+        return 0; // Standing still.
+    }
+
+    // Check for collisions along the whole move and only complete it if no collision occurs.
+    float impact = field.sweptCubeCarCollision(pose, to);
+    if (impact > 1.0)
+    {
+        state.x = to.x;
+        state.z = to.z;
+        state.angle = to.angle;
+        state.speed = speed;
+        pose = to;
+
+        int triggered = field.triggerCollision(to.x, to.z, reached);
+        if (triggered & (1 << TRIGGER_HAZARD))
+        {
+            state.isCollision = 1; // Driving into a hazard loses like hitting a cube.
+            return EVENT_MOVED | EVENT_LOST;
+        }
+        if (triggered & (1 << TRIGGER_GOAL))
+        {
+            state.isWin = 1;
+            return EVENT_MOVED | EVENT_WON;
+        }
+        return EVENT_MOVED;
+    }
+
+    // Move the car up to the point of impact, where it stops.
+    state.x += impact * (to.x - state.x);
+    state.z += impact * (to.z - state.z);
+    state.angle += impact * (to.angle - state.angle);
+    state.speed = 0.0;
+    state.isCollision = 1;
+    pose = makeCarPose(state.x, state.z, state.angle);
+    return EVENT_MOVED | EVENT_LOST;
+}
+
+// Function to advance the car in state, whose pose is pose, through field by one
+// step with the given controls, setting reached[k] for each trigger k it reaches.
+// Returns a bitmask of the EVENT_* values that happened. Once the car has lost or
+// won, the controls are ignored. These are all the rules of the game; World and
+// WorldBatch both step through here or through its two halves.
+template <typename Field>
+int stepCar(const Field& field, CarState& state, CarPose& pose, unsigned char* reached,
+    const CarControls& controls)
+{
+    if (state.isCollision || state.isWin)
+        return 0; // Block all movement inputs during collision.
+
+    float x = state.x, z = state.z, angle = state.angle, speed = state.speed, headingX, headingZ;
+    integrateVehicle(x, z, angle, speed, headingX, headingZ, controls.throttle, controls.brake, controls.steer);
+    return resolveCarMove(field, state, pose, reached, makeCarPose(x, z, angle, headingX, headingZ), speed);
+}
+
+// Plain data at the start of every world snapshot. The snapshot goes on with one
+// reached flag per trigger of the layout, so a whole snapshot is one block of
+// bytes that can be saved and restored with a single memcpy.
+struct WorldSnapshot
+{
+    CarState car; // Pose and flags of the car.
+    Pcg32 random; // Generator of the next layout.
+    uint32_t steps; // Steps taken since the layout was generated.
+    uint32_t endStep; // Value of steps when the car lost or won, 0 while the game goes on.
+    uint32_t layout; // Number of the layout the snapshot belongs to, see World::getLayout().
+    uint32_t triggerCount; // Number of reached flags that follow.
+};
+
+// One game: an obstacle field and the car driving through it. step() depends
+// only on the world and its input. Everything that step() changes is kept in one
+// block of memory, a WorldSnapshot followed by the reached flags, so the state
+// can be saved and restored quickly to branch from or rewind to. The layout is
+// not part of it: snapshots only refer to the layout they were taken in.
+// Instead of its own field, a world can drive through a ChunkedWorld given to
+// setChunks(), which it updates around the car before each step.
+// A world runs its own timer wheel, ticked once per step, which resets it
+// RESET_DELAY_STEPS after the car lost or won: with a new layout if the layout
+// was generated, and in the same layout otherwise. So a world played headless
+// or replayed resets just like the game. The owner can schedule its own events
+// on getTimers(), which step() passes to the handler given to setTimerHandler().
+class World
+{
+public:
+    World();
+    void seed(uint64_t initState, uint64_t stream = 0) { header().random.seed(initState, stream); }
+    void generateLayout(const LayoutParams& params);
+    int loadLevel(const char* path);
+    void setChunks(ChunkedWorld* streamed) { chunks = streamed; }
+    void setResetDelay(uint32_t steps) { resetDelay = steps; }
+    void setTimerHandler(void (*handler)(int event, int value)) { timerHandler = handler; }
+    TimerWheel& getTimers() { return timers; }
+    void reset();
+    int step(const CarControls& controls);
+    int step(int input) { return step(inputControls(input)); }
+    const CarState& getState() const { return header().car; }
+    const CarPose& getPose() const { return pose; }
+    uint32_t getSteps() const { return header().steps; }
+    uint32_t getLayout() const { return layout; }
+    int isTriggerReached(int k) const { return stateBlock[sizeof(WorldSnapshot) + k]; }
+    int getSnapshotSize() const { return (int)stateBlock.size(); }
+    void saveSnapshot(void* snapshot) const { memcpy(snapshot, stateBlock.data(), stateBlock.size()); }
+    int loadSnapshot(const void* snapshot);
+
+    ObstacleField field; // Cubes and trigger areas with their collision structures.
+
+private:
+    WorldSnapshot& header() { return *(WorldSnapshot*)stateBlock.data(); }
+    const WorldSnapshot& header() const { return *(const WorldSnapshot*)stateBlock.data(); }
+
+    std::vector<unsigned char> stateBlock; // WorldSnapshot followed by one reached flag per trigger.
+    CarPose pose; // Pose of the car, derived from its state.
+    uint32_t layout; // Number of layouts generated so far.
+    ChunkedWorld* chunks; // World of chunks driven through instead of field, if any; not owned.
+    LayoutParams layoutParams; // Parameters of the last layout generated.
+    int generated; // Was the layout generated rather than loaded from a level file?
+    TimerWheel timers; // Events of the world and of its owner, ticked once per step.
+    TimerHandle resetTimer; // Pending reset of the world, if any.
+    uint32_t resetDelay; // Steps from a win or loss to the reset, 0 for none.
+    void (*timerHandler)(int event, int value); // Called for the owner's events, if set.
+};
+
+// World constructor.
+inline World::World()
+{
+    stateBlock.resize(sizeof(WorldSnapshot));
+    header().random = Pcg32();
+    layout = 0;
+    chunks = 0;
+    layoutParams = makeLayoutParams(0, 0, 0);
+    generated = 0;
+    resetTimer.index = resetTimer.generation = 0;
+    resetDelay = RESET_DELAY_STEPS;
+    timerHandler = 0;
+    reset();
+}
+
+// Function to generate a new layout with params, build its collision structures
+// and put the car back at the start. Successive layouts follow from the seed()
+// given.
+inline void World::generateLayout(const LayoutParams& params)
+{
+    field.generateLayout(params, header().random);
+    field.build();
+    layoutParams = params;
+    generated = 1;
+    layout++;
+    reset();
+}
+
+// Function to use the level file at path as the layout and put the car back at
+// the start. Returns 1 on success and 0 if the file cannot be loaded, in which
+// case the layout is unchanged.
+inline int World::loadLevel(const char* path)
+{
+    if (!loadLevelFile(path, field))
+        return 0;
+    generated = 0;
+    layout++;
+    reset();
+    return 1;
+}
+
+// Function to put the car back at the start of the current layout, dropping any
+// pending reset.
+inline void World::reset()
+{
+    timers.cancel(resetTimer);
+    stateBlock.resize(sizeof(WorldSnapshot) + field.triggers.getCount());
+    WorldSnapshot& state = header();
+    state.car.x = state.car.z = state.car.angle = state.car.speed = 0.0;
+    state.car.isCollision = state.car.isWin = 0;
+    pose = makeCarPose(state.car.x, state.car.z, state.car.angle);
+    state.steps = 0;
+    state.endStep = 0;
+    state.layout = layout;
+    state.triggerCount = field.triggers.getCount();
+    memset(stateBlock.data() + sizeof(WorldSnapshot), 0, state.triggerCount);
+}
+
+// Function to advance the world by one step with the given controls, then tick
+// its timer wheel. Returns a bitmask of the EVENT_* values that happened. Once the
+// car has lost or won, controls are ignored until the world resets, which a win
+// or loss schedules resetDelay steps ahead.
+inline int World::step(const CarControls& controls)
+{
+    WorldSnapshot& state = header();
+    int events;
+
+    state.steps++;
+    if (chunks)
+    {
+        chunks->update(state.car.x, state.car.z);
+        events = stepCar(*chunks, state.car, pose, stateBlock.data() + sizeof(WorldSnapshot), controls);
+    }
+    else
+        events = stepCar(field, state.car, pose, stateBlock.data() + sizeof(WorldSnapshot), controls);
+    if ((events & (EVENT_LOST | EVENT_WON)) && resetDelay > 0)
+    {
+        state.endStep = state.steps;
+        resetTimer = timers.schedule(resetDelay, TIMER_RESET_WORLD, 0, 1);
+    }
+
+    timers.advance(1, [&](int event, int value)
+        {
+            if (event == TIMER_RESET_WORLD)
+            {
+                if (generated && !chunks)
+                    generateLayout(layoutParams);
+                else
+                    reset();
+                events |= EVENT_RESET;
+            }
+            else if (timerHandler)
+                timerHandler(event, value);
+        });
+    return events;
+}
+
+// Function to restore the state saved by saveSnapshot(). Returns 1 on success and
+// 0, leaving the world as it is, if the snapshot was taken in another layout.
+inline int World::loadSnapshot(const void* snapshot)
+{
+    WorldSnapshot saved;
+    memcpy(&saved, snapshot, sizeof(saved));
+    if (saved.layout != layout || saved.triggerCount != header().triggerCount)
+        return 0;
+    memcpy(stateBlock.data(), snapshot, stateBlock.size());
+    pose = makeCarPose(header().car.x, header().car.z, header().car.angle);
+
+    // Put the pending reset back as far ahead as it was when the snapshot was
+    // taken: the reset scheduled in step endStep fires in step endStep + resetDelay - 1.
+    timers.cancel(resetTimer);
+    if (header().endStep > 0 && resetDelay > 0)
+        resetTimer = timers.schedule(header().endStep + resetDelay - 1 - header().steps, TIMER_RESET_WORLD, 0, 1);
+    return 1;
+}
+
+#endif